@@ -29,6 +29,21 @@
 
 #include "WirehairCodec.h"
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+#include <list>
+#include <memory>
+#include <mutex>
+#endif
+
+#if defined(CAT_STRIPED_VALUES)
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#endif
+
 
 //------------------------------------------------------------------------------
 // Precompiler-conditional console output
@@ -92,10 +107,10 @@ bool Codec::OpportunisticPeeling(
 
         CAT_IF_DUMP(cout << column_i << " ";)
 
-        PeelRefs *refs = &_peel_col_refs[column_i];
+        uint16_t& ref_count = _peel_col_ref_counts[column_i];
 
         // If there was not enough room in the reference list:
-        if (refs->RowCount >= CAT_REF_LIST_MAX)
+        if (ref_count >= CAT_REF_LIST_MAX)
         {
             CAT_IF_DUMP(cout << "OpportunisticPeeling: Failure!  " \
                 "Ran out of space for row references.  CAT_REF_LIST_MAX must be increased!" << endl;)
@@ -108,10 +123,10 @@ bool Codec::OpportunisticPeeling(
         }
 
         // Add row reference to column
-        refs->Rows[refs->RowCount++] = row_i;
+        _peel_col_refs[column_i].Rows[ref_count++] = row_i;
 
         // If column is unmarked:
-        if (_peel_cols[column_i].Mark == MARK_TODO) {
+        if (_peel_col_marks[column_i] == MARK_TODO) {
             unmarked[unmarked_count++ & 1] = column_i;
         }
     } while (iter.Iterate());
@@ -119,7 +134,7 @@ bool Codec::OpportunisticPeeling(
     CAT_IF_DUMP(cout << endl;)
 
     // Initialize row state
-    row->UnmarkedCount = unmarked_count;
+    _peel_row_unmarked[row_i] = unmarked_count;
 
     switch (unmarked_count)
     {
@@ -143,8 +158,8 @@ bool Codec::OpportunisticPeeling(
         row->Marks.Unmarked[1] = unmarked[1];
 
         // Increment weight-2 reference count for unmarked columns
-        _peel_cols[unmarked[0]].Weight2Refs++;
-        _peel_cols[unmarked[1]].Weight2Refs++;
+        _peel_col_weight2_refs[unmarked[0]]++;
+        _peel_col_weight2_refs[unmarked[1]]++;
         break;
     }
 
@@ -172,11 +187,9 @@ void Codec::FixPeelFailure(
 
         CAT_IF_DUMP(cout << " " << column;)
 
-        PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[column];
-
         // Subtract off row count.
         // This invalidates the row number that was written earlier
-        refs->RowCount--;
+        _peel_col_ref_counts[column]--;
     } while (iter.Iterate());
     CAT_IF_DUMP(cout << endl;)
 }
@@ -185,9 +198,8 @@ void Codec::PeelAvalancheOnSolve(
     uint16_t column_i ///< Column that was solved
 )
 {
-    PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[column_i];
-    uint16_t ref_row_count = refs->RowCount;
-    uint16_t * GF256_RESTRICT ref_rows = refs->Rows;
+    uint16_t ref_row_count = _peel_col_ref_counts[column_i];
+    uint16_t * GF256_RESTRICT ref_rows = _peel_col_refs[column_i].Rows;
 
     // Walk list of peeled rows referenced by this newly solved column
     while (ref_row_count--)
@@ -195,7 +207,7 @@ void Codec::PeelAvalancheOnSolve(
         // Update unmarked row count for this referenced row
         uint16_t ref_row_i = *ref_rows++;
         PeelRow * GF256_RESTRICT ref_row = &_peel_rows[ref_row_i];
-        uint16_t unmarked_count = --ref_row->UnmarkedCount;
+        uint16_t unmarked_count = --_peel_row_unmarked[ref_row_i];
 
         // If row may be solving a column now:
         if (unmarked_count == 1)
@@ -214,7 +226,7 @@ void Codec::PeelAvalancheOnSolve(
             */
 
             // If column is already solved:
-            if (_peel_cols[new_column_i].Mark == MARK_TODO)
+            if (_peel_col_marks[new_column_i] == MARK_TODO)
             {
                 SolveWithPeel(
                     ref_row,
@@ -242,16 +254,14 @@ void Codec::PeelAvalancheOnSolve(
             {
                 const uint16_t ref_column_i = ref_iter.GetColumn();
 
-                PeelColumn * GF256_RESTRICT ref_col = &_peel_cols[ref_column_i];
-
                 // If column is unmarked:
-                if (ref_col->Mark == MARK_TODO)
+                if (_peel_col_marks[ref_column_i] == MARK_TODO)
                 {
                     // Store the two unmarked columns in the row
                     ref_row->Marks.Unmarked[store_count++] = ref_column_i;
 
                     // Increment weight-2 reference count (cannot hurt even if not true)
-                    ref_col->Weight2Refs++;
+                    _peel_col_weight2_refs[ref_column_i]++;
                 }
             } while (ref_iter.Iterate());
 
@@ -263,7 +273,7 @@ void Codec::PeelAvalancheOnSolve(
             if (store_count <= 1)
             {
                 // Insure that this row won't be processed further during this recursion
-                ref_row->UnmarkedCount = 0;
+                _peel_row_unmarked[ref_row_i] = 0;
 
                 // If row is to be deferred:
                 if (store_count == 1)
@@ -296,7 +306,7 @@ void Codec::SolveWithPeel(
     PeelColumn * GF256_RESTRICT column = &_peel_cols[column_i];
 
     // Mark this column as solved
-    column->Mark = MARK_PEEL;
+    _peel_col_marks[column_i] = MARK_PEEL;
 
     // Remember which column it solves
     row->Marks.Result.PeelColumn = column_i;
@@ -321,6 +331,28 @@ void Codec::SolveWithPeel(
     column->PeelRow = row_i;
 }
 
+/// Columns per group in the GreedyPeeling() scan
+static const unsigned kGreedyPeelGroup = 64;
+
+/**
+    GreedyPeelKey()
+
+    Orders the unmarked columns for GreedyPeeling() by weight-2 references,
+    then by all row references.  Zero for marked columns.
+*/
+static GF256_FORCE_INLINE uint32_t GreedyPeelKey(
+    const uint8_t * GF256_RESTRICT marks,
+    const uint16_t * GF256_RESTRICT weight2_refs,
+    const uint16_t * GF256_RESTRICT ref_counts,
+    unsigned column_i)
+{
+    const uint32_t key = ((uint32_t)weight2_refs[column_i] << 16) | ref_counts[column_i];
+
+    // Written as a mask so that the scan vectorizes
+    const uint32_t todo_mask = 0u - (uint32_t)(marks[column_i] == MARK_TODO);
+    return (key + 1) & todo_mask;
+}
+
 void Codec::GreedyPeeling()
 {
     CAT_IF_DUMP(cout << endl << "---- GreedyPeeling ----" << endl << endl;)
@@ -330,50 +362,56 @@ void Codec::GreedyPeeling()
     _defer_count = 0;
 
     const unsigned block_count = _block_count;
+    const uint8_t * GF256_RESTRICT marks = _peel_col_marks;
+    const uint16_t * GF256_RESTRICT weight2_refs = _peel_col_weight2_refs;
+    const uint16_t * GF256_RESTRICT ref_counts = _peel_col_ref_counts;
 
     // Until all columns are marked:
     for (;;)
     {
-        uint16_t best_column_i = LIST_TERM;
-        unsigned best_w2_refs = 0;
-        unsigned best_row_count = 0;
-
-        const PeelColumn *column = _peel_cols;
-
-        // For each peel column:
-        for (uint16_t column_i = 0; column_i < block_count; ++column_i, ++column)
+        /*
+            Find the best key one group of columns at a time, so that the
+            inner loop vectorizes, and remember the last group that has it.
+            Ties go to the last column.
+        */
+        uint32_t best_key = 0;
+        unsigned best_group_i = 0;
+        for (unsigned group_i = 0; group_i < block_count; group_i += kGreedyPeelGroup)
         {
-            // If column is not marked yet:
-            if (column->Mark == MARK_TODO)
-            {
-                const unsigned w2_refs = column->Weight2Refs;
+            const unsigned group_end = (block_count - group_i < kGreedyPeelGroup) ?
+                block_count : group_i + kGreedyPeelGroup;
 
-                // If it may have the most weight-2 references:
-                if (w2_refs >= best_w2_refs)
-                {
-                    const unsigned row_count = _peel_col_refs[column_i].RowCount;
+            uint32_t group_key = 0;
+            for (unsigned column_i = group_i; column_i < group_end; ++column_i)
+            {
+                const uint32_t key = GreedyPeelKey(marks, weight2_refs, ref_counts, column_i);
+                group_key = (key > group_key) ? key : group_key;
+            }
 
-                    // If it has the largest row references overall:
-                    if (w2_refs > best_w2_refs || row_count >= best_row_count)
-                    {
-                        // Use that one
-                        best_column_i = column_i;
-                        best_w2_refs = w2_refs;
-                        best_row_count = row_count;
-                    }
-                }
+            if (group_key >= best_key)
+            {
+                best_key = group_key;
+                best_group_i = group_i;
             }
         }
 
         // If no column was found:
-        if (best_column_i == LIST_TERM) {
+        if (best_key == 0) {
             // Peeling is complete
             break;
         }
 
+        // Use the last column in that group with the key
+        uint16_t best_column_i = static_cast<uint16_t>(
+            (block_count - best_group_i < kGreedyPeelGroup) ?
+            block_count - 1 : best_group_i + kGreedyPeelGroup - 1);
+        while (GreedyPeelKey(marks, weight2_refs, ref_counts, best_column_i) != best_key) {
+            --best_column_i;
+        }
+
         // Mark column as deferred
         PeelColumn *best_column = &_peel_cols[best_column_i];
-        best_column->Mark = MARK_DEFER;
+        _peel_col_marks[best_column_i] = MARK_DEFER;
         ++_defer_count;
 
         // Add at head of deferred list
@@ -381,7 +419,7 @@ void Codec::GreedyPeeling()
         _defer_head_columns = best_column_i;
 
         CAT_IF_DUMP(cout << "Deferred column " << best_column_i <<
-            " for Gaussian elimination, which had " << best_column->Weight2Refs <<
+            " for Gaussian elimination, which had " << weight2_refs[best_column_i] <<
             " weight-2 row references" << endl;)
 
         // Peel resuming from where this column left off
@@ -419,7 +457,7 @@ void Codec::SetDeferredColumns()
         const PeelRefs * GF256_RESTRICT refs = &_peel_col_refs[defer_i];
 
         // For each affected row:
-        for (unsigned i = 0, count = refs->RowCount; i < count; ++i)
+        for (unsigned i = 0, count = _peel_col_ref_counts[defer_i]; i < count; ++i)
         {
             const uint16_t row_i = refs->Rows[i];
 
@@ -495,7 +533,7 @@ void Codec::SetMixingColumnsForDeferredRows()
     }
 }
 
-void Codec::PeelDiagonal()
+void Codec::PeelDiagonal(bool values_only)
 {
     CAT_IF_DUMP(cout << endl << "---- PeelDiagonal ----" << endl << endl;)
 
@@ -522,23 +560,27 @@ void Codec::PeelDiagonal()
 
         CAT_IF_DUMP(cout << "Peeled row " << peel_row_i << " for peeled column " << peel_column_i << " :";)
 
-        const unsigned defer_count = _defer_count;
-        const RowMixIterator mix(row->Params, _mix_count, _mix_next_prime);
-
-        // Generate mixing column 1
-        const unsigned ge_column_i = defer_count + mix.Columns[0];
-        ge_row[ge_column_i >> 6] ^= (uint64_t)1 << (ge_column_i & 63);
-        CAT_IF_DUMP(cout << " " << ge_column_i;)
-
-        // Generate mixing column 2
-        const unsigned ge_column_j = defer_count + mix.Columns[1];
-        ge_row[ge_column_j >> 6] ^= (uint64_t)1 << (ge_column_j & 63);
-        CAT_IF_DUMP(cout << " " << ge_column_j;)
-
-        // Generate mixing column 3
-        const unsigned ge_column_k = defer_count + mix.Columns[2];
-        ge_row[ge_column_k >> 6] ^= (uint64_t)1 << (ge_column_k & 63);
-        CAT_IF_DUMP(cout << " " << ge_column_k << endl;)
+        // If the Compression matrix was not restored from a SolvedMatrix:
+        if (!values_only)
+        {
+            const unsigned defer_count = _defer_count;
+            const RowMixIterator mix(row->Params, _mix_count, _mix_next_prime);
+
+            // Generate mixing column 1
+            const unsigned ge_column_i = defer_count + mix.Columns[0];
+            ge_row[ge_column_i >> 6] ^= (uint64_t)1 << (ge_column_i & 63);
+            CAT_IF_DUMP(cout << " " << ge_column_i;)
+
+            // Generate mixing column 2
+            const unsigned ge_column_j = defer_count + mix.Columns[1];
+            ge_row[ge_column_j >> 6] ^= (uint64_t)1 << (ge_column_j & 63);
+            CAT_IF_DUMP(cout << " " << ge_column_j;)
+
+            // Generate mixing column 3
+            const unsigned ge_column_k = defer_count + mix.Columns[2];
+            ge_row[ge_column_k >> 6] ^= (uint64_t)1 << (ge_column_k & 63);
+            CAT_IF_DUMP(cout << " " << ge_column_k << endl;)
+        }
 
         // Get pointer to output block
         CAT_DEBUG_ASSERT(peel_column_i < _recovery_rows);
@@ -577,7 +619,7 @@ void Codec::PeelDiagonal()
         const uint16_t * GF256_RESTRICT referencingRows = refs->Rows;
 
         // For each row that references this one:
-        for (unsigned i = 0, count = refs->RowCount; i < count; ++i)
+        for (unsigned i = 0, count = _peel_col_ref_counts[peel_column_i]; i < count; ++i)
         {
             const uint16_t ref_row_i = referencingRows[i];
 
@@ -589,11 +631,14 @@ void Codec::PeelDiagonal()
 
             CAT_IF_DUMP(cout << " " << ref_row_i;)
 
-            uint64_t * GF256_RESTRICT ge_ref_row = _compress_matrix + _ge_pitch * ref_row_i;
+            if (!values_only)
+            {
+                uint64_t * GF256_RESTRICT ge_ref_row = _compress_matrix + _ge_pitch * ref_row_i;
 
-            // Add GE row to referencing GE row
-            for (unsigned j = 0; j < _ge_pitch; ++j) {
-                ge_ref_row[j] ^= ge_row[j];
+                // Add GE row to referencing GE row
+                for (unsigned j = 0; j < _ge_pitch; ++j) {
+                    ge_ref_row[j] ^= ge_row[j];
+                }
             }
 
             PeelRow * GF256_RESTRICT ref_row = &_peel_rows[ref_row_i];
@@ -685,6 +730,7 @@ void Codec::MultiplyDenseRows()
     prng.Seed(_d_seed);
 
     const PeelColumn * GF256_RESTRICT column = _peel_cols;
+    const uint8_t * GF256_RESTRICT mark = _peel_col_marks;
     uint64_t * GF256_RESTRICT temp_row = _ge_matrix + _ge_pitch * (_dense_count + _defer_count);
     const unsigned dense_count = _dense_count;
     uint16_t rows[CAT_MAX_DENSE_ROWS];
@@ -693,7 +739,7 @@ void Codec::MultiplyDenseRows()
     // For each block of columns:
     for (unsigned column_i = 0, block_count = _block_count;
         column_i < block_count;
-        column_i += dense_count, column += dense_count)
+        column_i += dense_count, column += dense_count, mark += dense_count)
     {
         CAT_IF_DUMP(cout << "Shuffled dense matrix starting at column "
             << column_i << ":" << endl;)
@@ -727,7 +773,7 @@ void Codec::MultiplyDenseRows()
             // If bit is peeled:
             if (bit_i < max_x)
             {
-                if (column[bit_i].Mark == MARK_PEEL)
+                if (mark[bit_i] == MARK_PEEL)
                 {
                     const uint64_t * GF256_RESTRICT ge_source_row = _compress_matrix + _ge_pitch * column[bit_i].PeelRow;
 
@@ -778,7 +824,7 @@ void Codec::MultiplyDenseRows()
             // Flip bit 1
             if (bit0 < max_x)
             {
-                if (column[bit0].Mark == MARK_PEEL)
+                if (mark[bit0] == MARK_PEEL)
                 {
                     const uint16_t bit0_row = column[bit0].PeelRow;
                     const uint64_t * GF256_RESTRICT ge_source_row = _compress_matrix + _ge_pitch * bit0_row;
@@ -802,7 +848,7 @@ void Codec::MultiplyDenseRows()
             // Flip bit 2
             if (bit1 < max_x)
             {
-                if (column[bit1].Mark == MARK_PEEL)
+                if (mark[bit1] == MARK_PEEL)
                 {
                     const uint16_t bit1_row = column[bit1].PeelRow;
                     const uint64_t * GF256_RESTRICT ge_source_row = _compress_matrix + _ge_pitch * bit1_row;
@@ -850,7 +896,7 @@ void Codec::MultiplyDenseRows()
             // Flip bit 1
             if (bit0 < max_x)
             {
-                if (column[bit0].Mark == MARK_PEEL)
+                if (mark[bit0] == MARK_PEEL)
                 {
                     const uint16_t bit0_row = column[bit0].PeelRow;
                     const uint64_t * GF256_RESTRICT ge_source_row = _compress_matrix + _ge_pitch * bit0_row;
@@ -873,7 +919,7 @@ void Codec::MultiplyDenseRows()
             // Flip bit 2
             if (bit1 < max_x)
             {
-                if (column[bit1].Mark == MARK_PEEL)
+                if (mark[bit1] == MARK_PEEL)
                 {
                     const uint16_t bit1_row = column[bit1].PeelRow;
                     const uint64_t * GF256_RESTRICT ge_source_row = _compress_matrix + _ge_pitch * bit1_row;
@@ -1516,10 +1562,8 @@ void Codec::InitializeColumnValues()
         {
             const uint16_t column_i = iter.GetColumn();
 
-            PeelColumn * GF256_RESTRICT column = &_peel_cols[column_i];
-
             // If column is peeled:
-            if (column->Mark == MARK_PEEL)
+            if (_peel_col_marks[column_i] == MARK_PEEL)
             {
                 CAT_DEBUG_ASSERT(column_i < _recovery_rows);
                 const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * column_i;
@@ -1569,28 +1613,31 @@ void Codec::InitializeColumnValues()
     CAT_IF_ROWOP(cout << "InitializeColumnValues used " << rowops << " row ops = " << rowops / (double)_block_count << "*N" << endl;)
 }
 
-void Codec::MultiplyDenseValues()
+void Codec::MultiplyDenseValues(unsigned offset, unsigned bytes)
 {
     CAT_IF_DUMP(cout << endl << "---- MultiplyDenseValues ----" << endl << endl;)
 
     CAT_IF_ROWOP(uint32_t rowops = 0;)
 
+    // The stripe of the block values to work on
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + offset;
+
     // Initialize PRNG
     PCGRandom prng;
     prng.Seed(_d_seed);
 
     const uint16_t dense_count = _dense_count;
     CAT_DEBUG_ASSERT((unsigned)(_block_count + _mix_count) < _recovery_rows);
-    uint8_t * GF256_RESTRICT temp_block = _recovery_blocks + _block_bytes * (_block_count + _mix_count);
-    const uint8_t * GF256_RESTRICT source_block = _recovery_blocks;
-    const PeelColumn * GF256_RESTRICT column = _peel_cols;
+    uint8_t * GF256_RESTRICT temp_block = recovery_blocks + _block_bytes * (_block_count + _mix_count);
+    const uint8_t * GF256_RESTRICT source_block = recovery_blocks;
+    const uint8_t * GF256_RESTRICT mark = _peel_col_marks;
     uint16_t rows[CAT_MAX_DENSE_ROWS];
     uint16_t bits[CAT_MAX_DENSE_ROWS];
     const uint16_t block_count = _block_count;
 
     // For each block of columns:
     for (uint16_t column_i = 0; column_i < block_count; column_i += dense_count,
-        column += dense_count, source_block += _block_bytes * dense_count)
+        mark += dense_count, source_block += _block_bytes * dense_count)
     {
         unsigned max_x = dense_count;
 
@@ -1623,7 +1670,7 @@ void Codec::MultiplyDenseValues()
             unsigned bit_i = set_bits[ii];
 
             // If bit is peeled:
-            if (bit_i < max_x && column[bit_i].Mark == MARK_PEEL)
+            if (bit_i < max_x && mark[bit_i] == MARK_PEEL)
             {
                 CAT_IF_DUMP(cout << " " << column_i + bit_i;)
 
@@ -1636,14 +1683,14 @@ void Codec::MultiplyDenseValues()
                 else if (combo == temp_block)
                 {
                     // Else if combo has been used: XOR it in
-                    gf256_add_mem(temp_block, src, _block_bytes);
+                    gf256_add_mem(temp_block, src, bytes);
 
                     CAT_IF_ROWOP(++rowops;)
                 }
                 else
                 {
                     // Else if combo needs to be used: Combine into block
-                    gf256_addset_mem(temp_block, combo, src, _block_bytes);
+                    gf256_addset_mem(temp_block, combo, src, bytes);
 
                     CAT_IF_ROWOP(++rowops;)
 
@@ -1656,14 +1703,14 @@ void Codec::MultiplyDenseValues()
 
         // If no combo ever triggered:
         if (!combo) {
-            memset(temp_block, 0, _block_bytes);
+            memset(temp_block, 0, bytes);
         }
         else
         {
             // Else if never combined two: Just copy it
             if (combo != temp_block)
             {
-                memcpy(temp_block, combo, _block_bytes);
+                memcpy(temp_block, combo, bytes);
                 CAT_IF_ROWOP(++rowops;)
             }
 
@@ -1673,7 +1720,7 @@ void Codec::MultiplyDenseValues()
             if (dest_column_i != LIST_TERM)
             {
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
-                gf256_add_mem(_recovery_blocks + _block_bytes * dest_column_i, temp_block, _block_bytes);
+                gf256_add_mem(recovery_blocks + _block_bytes * dest_column_i, temp_block, bytes);
                 CAT_IF_ROWOP(++rowops;)
             }
         }
@@ -1696,9 +1743,9 @@ void Codec::MultiplyDenseValues()
             const unsigned bit1 = clr_bits[ii];
 
             // Add in peeled columns
-            if (bit0 < max_x && column[bit0].Mark == MARK_PEEL)
+            if (bit0 < max_x && mark[bit0] == MARK_PEEL)
             {
-                if (bit1 < max_x && column[bit1].Mark == MARK_PEEL)
+                if (bit1 < max_x && mark[bit1] == MARK_PEEL)
                 {
                     CAT_IF_DUMP(cout << " " << column_i + bit0 << "+" << column_i + bit1;)
 
@@ -1706,7 +1753,7 @@ void Codec::MultiplyDenseValues()
                         temp_block,
                         source_block + _block_bytes * bit0,
                         source_block + _block_bytes * bit1,
-                        _block_bytes);
+                        bytes);
                 }
                 else
                 {
@@ -1715,18 +1762,18 @@ void Codec::MultiplyDenseValues()
                     gf256_add_mem(
                         temp_block,
                         source_block + _block_bytes * bit0,
-                        _block_bytes);
+                        bytes);
                 }
                 CAT_IF_ROWOP(++rowops;)
             }
-            else if (bit1 < max_x && column[bit1].Mark == MARK_PEEL)
+            else if (bit1 < max_x && mark[bit1] == MARK_PEEL)
             {
                 CAT_IF_DUMP(cout << " " << column_i + bit1;)
 
                 gf256_add_mem(
                     temp_block,
                     source_block + _block_bytes * bit1,
-                    _block_bytes);
+                    bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1741,9 +1788,9 @@ void Codec::MultiplyDenseValues()
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
 
                 gf256_add_mem(
-                    _recovery_blocks + _block_bytes * dest_column_i,
+                    recovery_blocks + _block_bytes * dest_column_i,
                     temp_block,
-                    _block_bytes);
+                    bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1765,9 +1812,9 @@ void Codec::MultiplyDenseValues()
             const unsigned bit0 = set_bits[ii];
             const unsigned bit1 = clr_bits[ii];
 
-            if (bit0 < max_x && column[bit0].Mark == MARK_PEEL)
+            if (bit0 < max_x && mark[bit0] == MARK_PEEL)
             {
-                if (bit1 < max_x && column[bit1].Mark == MARK_PEEL)
+                if (bit1 < max_x && mark[bit1] == MARK_PEEL)
                 {
                     CAT_IF_DUMP(cout << " " << column_i + bit0 << "+" << column_i + bit1;)
 
@@ -1778,7 +1825,7 @@ void Codec::MultiplyDenseValues()
                         temp_block,
                         source_block + _block_bytes * bit0,
                         source_block + _block_bytes * bit1,
-                        _block_bytes);
+                        bytes);
                 }
                 else
                 {
@@ -1789,12 +1836,12 @@ void Codec::MultiplyDenseValues()
                     gf256_add_mem(
                         temp_block,
                         source_block + _block_bytes * bit0,
-                        _block_bytes);
+                        bytes);
                 }
 
                 CAT_IF_ROWOP(++rowops;)
             }
-            else if (bit1 < max_x && column[bit1].Mark == MARK_PEEL)
+            else if (bit1 < max_x && mark[bit1] == MARK_PEEL)
             {
                 CAT_IF_DUMP(cout << " " << column_i + bit1;)
 
@@ -1803,7 +1850,7 @@ void Codec::MultiplyDenseValues()
                 gf256_add_mem(
                     temp_block,
                     source_block + _block_bytes * bit1,
-                    _block_bytes);
+                    bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1818,9 +1865,9 @@ void Codec::MultiplyDenseValues()
                 CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
 
                 gf256_add_mem(
-                    _recovery_blocks + _block_bytes * dest_column_i,
+                    recovery_blocks + _block_bytes * dest_column_i,
                     temp_block,
-                    _block_bytes);
+                    bytes);
 
                 CAT_IF_ROWOP(++rowops;)
             }
@@ -1836,12 +1883,15 @@ void Codec::MultiplyDenseValues()
 #define CAT_UNDER_WIN_THRESH_6 (85 + 6)
 #define CAT_UNDER_WIN_THRESH_7 (138 + 7)
 
-void Codec::AddSubdiagonalValues()
+void Codec::AddSubdiagonalValues(unsigned offset, unsigned bytes)
 {
     CAT_IF_DUMP(cout << endl << "---- AddSubdiagonalValues ----" << endl << endl;)
 
     CAT_IF_ROWOP(uint32_t rowops = 0; unsigned heavyops = 0;)
 
+    // The stripe of the block values to work on
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + offset;
+
     const unsigned column_count = _defer_count + _mix_count;
     unsigned pivot_i = 0;
     const uint16_t first_heavy_row = _defer_count + _dense_count;
@@ -1883,14 +1933,14 @@ void Codec::AddSubdiagonalValues()
         // Note that the peeled column values were previously used up until this point,
         // but now they are unused, and so they can be reused for temporary space
         uint8_t * GF256_RESTRICT win_table[128];
-        const PeelColumn * GF256_RESTRICT column = _peel_cols;
-        uint8_t * GF256_RESTRICT column_src = _recovery_blocks;
+        const uint8_t * GF256_RESTRICT mark = _peel_col_marks;
+        uint8_t * GF256_RESTRICT column_src = recovery_blocks;
         uint32_t jj = 1;
 
-        for (uint32_t count = _block_count; count > 0; --count, ++column, column_src += _block_bytes)
+        for (uint32_t count = _block_count; count > 0; --count, ++mark, column_src += _block_bytes)
         {
             // If column is peeled:
-            if (column->Mark == MARK_PEEL)
+            if (*mark == MARK_PEEL)
             {
                 // Reuse the block value temporarily as window table space
                 win_table[jj] = column_src;
@@ -1925,7 +1975,7 @@ void Codec::AddSubdiagonalValues()
             for (unsigned src_pivot_i = pivot_i; src_pivot_i < final_i; ++src_pivot_i)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[src_pivot_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
+                uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
 
                 CAT_IF_DUMP(cout << "Back-substituting small triangle from pivot " << src_pivot_i << "[" << (unsigned)src[0] << "] :";)
 
@@ -1944,10 +1994,10 @@ void Codec::AddSubdiagonalValues()
                         CAT_DEBUG_ASSERT(dest_col_i < _block_count + _mix_count);
 
                         CAT_DEBUG_ASSERT(dest_col_i < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * dest_col_i;
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * dest_col_i;
 
                         // Back-substitute
-                        gf256_add_mem(dest, src, _block_bytes);
+                        gf256_add_mem(dest, src, bytes);
 
                         CAT_IF_ROWOP(++rowops;)
 
@@ -1964,25 +2014,25 @@ void Codec::AddSubdiagonalValues()
 
             // Generate window table: 2 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i] < _recovery_rows);
-            win_table[1] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
+            win_table[1] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 1] < _recovery_rows);
-            win_table[2] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 1];
-            gf256_addset_mem(win_table[3], win_table[1], win_table[2], _block_bytes);
+            win_table[2] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 1];
+            gf256_addset_mem(win_table[3], win_table[1], win_table[2], bytes);
             CAT_IF_ROWOP(++rowops;)
 
             // Generate window table: 3 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 2] < _recovery_rows);
-            win_table[4] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 2];
-            gf256_addset_mem(win_table[5], win_table[1], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[6], win_table[2], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[7], win_table[1], win_table[6], _block_bytes);
+            win_table[4] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 2];
+            gf256_addset_mem(win_table[5], win_table[1], win_table[4], bytes);
+            gf256_addset_mem(win_table[6], win_table[2], win_table[4], bytes);
+            gf256_addset_mem(win_table[7], win_table[1], win_table[6], bytes);
             CAT_IF_ROWOP(rowops += 3;)
 
             // Generate window table: 4 bits
             CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 3] < _recovery_rows);
-            win_table[8] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 3];
+            win_table[8] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 3];
             for (unsigned ii = 1; ii < 8; ++ii) {
-                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], _block_bytes);
+                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], bytes);
             }
             CAT_IF_ROWOP(rowops += 7;)
 
@@ -1990,27 +2040,27 @@ void Codec::AddSubdiagonalValues()
             if (w >= 5)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 4] < _recovery_rows);
-                win_table[16] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 4];
+                win_table[16] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 4];
                 for (unsigned ii = 1; ii < 16; ++ii) {
-                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], _block_bytes);
+                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], bytes);
                 }
                 CAT_IF_ROWOP(rowops += 15;)
 
                 if (w >= 6)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 5] < _recovery_rows);
-                    win_table[32] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 5];
+                    win_table[32] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 5];
                     for (unsigned ii = 1; ii < 32; ++ii) {
-                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], _block_bytes);
+                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], bytes);
                     }
                     CAT_IF_ROWOP(rowops += 31;)
 
                     if (w >= 7)
                     {
                         CAT_DEBUG_ASSERT(_ge_col_map[pivot_i + 6] < _recovery_rows);
-                        win_table[64] = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 6];
+                        win_table[64] = recovery_blocks + _block_bytes * _ge_col_map[pivot_i + 6];
                         for (unsigned ii = 1; ii < 64; ++ii) {
-                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], _block_bytes);
+                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], bytes);
                         }
                         CAT_IF_ROWOP(rowops += 63;)
                     }
@@ -2045,8 +2095,8 @@ void Codec::AddSubdiagonalValues()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << ge_below_i << endl;)
 
                         // Back-substitute
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
+                        gf256_add_mem(dest, win_table[win_bits], bytes);
                         CAT_IF_ROWOP(++rowops;)
                     }
                 }
@@ -2074,8 +2124,8 @@ void Codec::AddSubdiagonalValues()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << ge_below_i << endl;)
 
                         // Back-substitute
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_below_i];
+                        gf256_add_mem(dest, win_table[win_bits], bytes);
                         CAT_IF_ROWOP(++rowops;)
                     }
                 }
@@ -2118,7 +2168,7 @@ void Codec::AddSubdiagonalValues()
         const unsigned column_i = _ge_col_map[ge_column_i];
         const uint16_t ge_row_i = _pivots[ge_column_i];
         CAT_DEBUG_ASSERT(column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * column_i;
+        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * column_i;
 
         CAT_IF_DUMP(cout << "Pivot " << ge_column_i << " solving column " << column_i << "[" << (unsigned)dest[0] << "] with GE row " << ge_row_i << " :";)
 
@@ -2141,9 +2191,9 @@ void Codec::AddSubdiagonalValues()
 
                 // Look up data source
                 CAT_DEBUG_ASSERT(_ge_col_map[sub_i] < _recovery_rows);
-                const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[sub_i];
+                const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[sub_i];
 
-                gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                gf256_muladd_mem(dest, code_value, src, bytes);
 
                 CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                 CAT_IF_DUMP(cout << " h" << ge_column_i << "=[" << (unsigned)src[0] << "*" << (unsigned)code_value << "]";)
@@ -2174,10 +2224,10 @@ void Codec::AddSubdiagonalValues()
             {
                 const unsigned column_j = _ge_col_map[bit_j];
                 CAT_DEBUG_ASSERT(column_j < _recovery_rows);
-                const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * column_j;
+                const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * column_j;
 
                 // Add pivot for non-zero bit to destination row value
-                gf256_add_mem(dest, src, _block_bytes);
+                gf256_add_mem(dest, src, bytes);
                 CAT_IF_ROWOP(++rowops;)
 
                 CAT_IF_DUMP(cout << " " << bit_j << "=[" << (unsigned)src[0] << "]";)
@@ -2198,12 +2248,15 @@ void Codec::AddSubdiagonalValues()
 #define CAT_ABOVE_WIN_THRESH_6 (64 + 6)
 #define CAT_ABOVE_WIN_THRESH_7 (128 + 7)
 
-void Codec::BackSubstituteAboveDiagonal()
+void Codec::BackSubstituteAboveDiagonal(unsigned offset, unsigned bytes)
 {
     CAT_IF_DUMP(cout << endl << "---- BackSubstituteAboveDiagonal ----" << endl << endl;)
 
     CAT_IF_ROWOP(unsigned rowops = 0; unsigned heavyops = 0;)
 
+    // The stripe of the block values to work on
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + offset;
+
     const unsigned pivot_count = _defer_count + _mix_count;
     unsigned pivot_i = pivot_count - 1;
     const uint16_t first_heavy_row = _defer_count + _dense_count;
@@ -2239,15 +2292,15 @@ void Codec::BackSubstituteAboveDiagonal()
         // NOTE: The peeled column values were previously used up until this point,
         // but now they are unused, and so they can be reused for temporary space.
         uint8_t * GF256_RESTRICT win_table[128];
-        const PeelColumn * GF256_RESTRICT column = _peel_cols;
-        uint8_t * GF256_RESTRICT column_src = _recovery_blocks;
+        const uint8_t * GF256_RESTRICT mark = _peel_col_marks;
+        uint8_t * GF256_RESTRICT column_src = recovery_blocks;
         uint32_t jj = 1;
 
         // For each original data column:
-        for (unsigned count = _block_count; count > 0; --count, ++column, column_src += _block_bytes)
+        for (unsigned count = _block_count; count > 0; --count, ++mark, column_src += _block_bytes)
         {
             // If column is peeled:
-            if (column->Mark == MARK_PEEL)
+            if (*mark == MARK_PEEL)
             {
                 // Reuse the block value temporarily as window table space
                 win_table[jj] = column_src;
@@ -2281,7 +2334,7 @@ void Codec::BackSubstituteAboveDiagonal()
             for (unsigned src_pivot_i = pivot_i; src_pivot_i > backsub_i; --src_pivot_i)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[src_pivot_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
+                uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[src_pivot_i];
 
                 const uint16_t ge_row_i = _pivots[src_pivot_i];
 
@@ -2300,7 +2353,7 @@ void Codec::BackSubstituteAboveDiagonal()
 
                     // Normalize code value, setting it to 1 (implicitly nonzero)
                     if (code_value != 1) {
-                        gf256_div_mem(src, src, code_value, _block_bytes);
+                        gf256_div_mem(src, src, code_value, bytes);
                         CAT_IF_ROWOP(++heavyops;)
                     }
 
@@ -2331,10 +2384,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         }
 
                         CAT_DEBUG_ASSERT(_ge_col_map[dest_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
 
                         // Back-substitute
-                        gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                        gf256_muladd_mem(dest, code_value, src, bytes);
 
                         CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                         CAT_IF_DUMP(cout << " h" << dest_pivot_i;)
@@ -2345,10 +2398,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         if (ge_row[_ge_pitch * dest_row_i] & ge_mask)
                         {
                             CAT_DEBUG_ASSERT(_ge_col_map[dest_pivot_i] < _recovery_rows);
-                            uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
+                            uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[dest_pivot_i];
 
                             // Back-substitute
-                            gf256_add_mem(dest, src, _block_bytes);
+                            gf256_add_mem(dest, src, bytes);
 
                             CAT_IF_ROWOP(++rowops;)
                             CAT_IF_DUMP(cout << " " << dest_pivot_i;)
@@ -2382,9 +2435,9 @@ void Codec::BackSubstituteAboveDiagonal()
                 if (code_value != 1)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[backsub_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
+                    uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
 
-                    gf256_div_mem(src, src, code_value, _block_bytes);
+                    gf256_div_mem(src, src, code_value, bytes);
                     CAT_IF_ROWOP(++heavyops;)
                 }
             }
@@ -2393,25 +2446,25 @@ void Codec::BackSubstituteAboveDiagonal()
 
             // Generate window table: 2 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i] < _recovery_rows);
-            win_table[1] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
+            win_table[1] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i];
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 1] < _recovery_rows);
-            win_table[2] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 1];
-            gf256_addset_mem(win_table[3], win_table[1], win_table[2], _block_bytes);
+            win_table[2] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 1];
+            gf256_addset_mem(win_table[3], win_table[1], win_table[2], bytes);
             CAT_IF_ROWOP(++rowops;)
 
             // Generate window table: 3 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 2] < _recovery_rows);
-            win_table[4] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 2];
-            gf256_addset_mem(win_table[5], win_table[1], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[6], win_table[2], win_table[4], _block_bytes);
-            gf256_addset_mem(win_table[7], win_table[1], win_table[6], _block_bytes);
+            win_table[4] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 2];
+            gf256_addset_mem(win_table[5], win_table[1], win_table[4], bytes);
+            gf256_addset_mem(win_table[6], win_table[2], win_table[4], bytes);
+            gf256_addset_mem(win_table[7], win_table[1], win_table[6], bytes);
             CAT_IF_ROWOP(rowops += 3;)
 
             // Generate window table: 4 bits
             CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 3] < _recovery_rows);
-            win_table[8] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 3];
+            win_table[8] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 3];
             for (unsigned ii = 1; ii < 8; ++ii) {
-                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], _block_bytes);
+                gf256_addset_mem(win_table[8 + ii], win_table[ii], win_table[8], bytes);
             }
             CAT_IF_ROWOP(rowops += 7;)
 
@@ -2419,27 +2472,27 @@ void Codec::BackSubstituteAboveDiagonal()
             if (w >= 5)
             {
                 CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 4] < _recovery_rows);
-                win_table[16] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 4];
+                win_table[16] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 4];
                 for (unsigned ii = 1; ii < 16; ++ii) {
-                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], _block_bytes);
+                    gf256_addset_mem(win_table[16 + ii], win_table[ii], win_table[16], bytes);
                 }
                 CAT_IF_ROWOP(rowops += 15;)
 
                 if (w >= 6)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 5] < _recovery_rows);
-                    win_table[32] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 5];
+                    win_table[32] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 5];
                     for (unsigned ii = 1; ii < 32; ++ii) {
-                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], _block_bytes);
+                        gf256_addset_mem(win_table[32 + ii], win_table[ii], win_table[32], bytes);
                     }
                     CAT_IF_ROWOP(rowops += 31;)
 
                     if (w >= 7)
                     {
                         CAT_DEBUG_ASSERT(_ge_col_map[backsub_i + 6] < _recovery_rows);
-                        win_table[64] = _recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 6];
+                        win_table[64] = recovery_blocks + _block_bytes * _ge_col_map[backsub_i + 6];
                         for (unsigned ii = 1; ii < 64; ++ii) {
-                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], _block_bytes);
+                            gf256_addset_mem(win_table[64 + ii], win_table[ii], win_table[64], bytes);
                         }
                         CAT_IF_ROWOP(rowops += 63;)
                     }
@@ -2462,7 +2515,7 @@ void Codec::BackSubstituteAboveDiagonal()
                     }
 
                     CAT_DEBUG_ASSERT(_ge_col_map[ge_above_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_above_i];
+                    uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_above_i];
                     unsigned ge_column_j = backsub_i;
 
                     // If the first column of window is not heavy:
@@ -2481,9 +2534,9 @@ void Codec::BackSubstituteAboveDiagonal()
                             if (nonzero)
                             {
                                 CAT_DEBUG_ASSERT(_ge_col_map[ge_column_j] < _recovery_rows);
-                                const uint8_t *src = _recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
+                                const uint8_t *src = recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
 
-                                gf256_add_mem(dest, src, _block_bytes);
+                                gf256_add_mem(dest, src, bytes);
 
                                 CAT_IF_ROWOP(++rowops;)
                             }
@@ -2512,10 +2565,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         }
 
                         CAT_DEBUG_ASSERT(_ge_col_map[ge_column_j] < _recovery_rows);
-                        const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
+                        const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[ge_column_j];
 
                         // Back-substitute
-                        gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                        gf256_muladd_mem(dest, code_value, src, bytes);
 
                         CAT_IF_ROWOP(if (code_value == 1) ++rowops; else ++heavyops;)
                     } // next column in row
@@ -2553,10 +2606,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << above_pivot_i << endl;)
 
                         CAT_DEBUG_ASSERT(_ge_col_map[above_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
 
                         // Back-substitute
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        gf256_add_mem(dest, win_table[win_bits], bytes);
 
                         CAT_IF_ROWOP(++rowops;)
                     }
@@ -2586,10 +2639,10 @@ void Codec::BackSubstituteAboveDiagonal()
                         CAT_IF_DUMP(cout << "Adding window table " << win_bits << " to pivot " << above_pivot_i << endl;)
 
                         CAT_DEBUG_ASSERT(_ge_col_map[above_pivot_i] < _recovery_rows);
-                        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
+                        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[above_pivot_i];
 
                         // Back-substitute
-                        gf256_add_mem(dest, win_table[win_bits], _block_bytes);
+                        gf256_add_mem(dest, win_table[win_bits], bytes);
 
                         CAT_IF_ROWOP(++rowops;)
                     }
@@ -2630,7 +2683,7 @@ void Codec::BackSubstituteAboveDiagonal()
     {
         // Calculate source
         CAT_DEBUG_ASSERT(_ge_col_map[pivot_i] < _recovery_rows);
-        uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
+        uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * _ge_col_map[pivot_i];
 
         const uint16_t ge_row_i = _pivots[pivot_i];
 
@@ -2649,7 +2702,7 @@ void Codec::BackSubstituteAboveDiagonal()
 
             // Normalize code value, setting it to 1 (implicitly nonzero)
             if (code_value != 1) {
-                gf256_div_mem(src, src, code_value, _block_bytes);
+                gf256_div_mem(src, src, code_value, bytes);
                 CAT_IF_ROWOP(++heavyops;)
             }
 
@@ -2679,10 +2732,10 @@ void Codec::BackSubstituteAboveDiagonal()
                 }
 
                 CAT_DEBUG_ASSERT(_ge_col_map[ge_up_i] < _recovery_rows);
-                uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
+                uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
 
                 // Back-substitute
-                gf256_muladd_mem(dest, code_value, src, _block_bytes);
+                gf256_muladd_mem(dest, code_value, src, bytes);
 
                 CAT_IF_ROWOP(if (code_value == 1) {
                     ++rowops;
@@ -2698,10 +2751,10 @@ void Codec::BackSubstituteAboveDiagonal()
                 if (ge_row[_ge_pitch * up_row_i] & ge_mask)
                 {
                     CAT_DEBUG_ASSERT(_ge_col_map[ge_up_i] < _recovery_rows);
-                    uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
+                    uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * _ge_col_map[ge_up_i];
 
                     // Back-substitute
-                    gf256_add_mem(dest, src, _block_bytes);
+                    gf256_add_mem(dest, src, bytes);
 
                     CAT_IF_ROWOP(++rowops;)
                     CAT_IF_DUMP(cout << " " << up_row_i;)
@@ -2722,12 +2775,16 @@ void Codec::BackSubstituteAboveDiagonal()
     CAT_IF_ROWOP(cout << "BackSubstituteAboveDiagonal used " << rowops << " row ops = " << rowops / (double)_block_count << "*N and " << heavyops << " heavy ops" << endl;)
 }
 
-void Codec::Substitute()
+void Codec::Substitute(unsigned offset, unsigned bytes)
 {
     CAT_IF_DUMP(cout << endl << "---- Substitute ----" << endl << endl;)
 
     CAT_IF_ROWOP(uint32_t rowops = 0;)
 
+    // The stripe of the block values to work on
+    uint8_t * GF256_RESTRICT recovery_blocks = _recovery_blocks + offset;
+    const uint8_t * GF256_RESTRICT input_blocks = _input_blocks + offset;
+
     PeelRow * GF256_RESTRICT row;
 
     // For each column that has been peeled:
@@ -2737,40 +2794,46 @@ void Codec::Substitute()
 
         const uint16_t dest_column_i = row->Marks.Result.PeelColumn;
         CAT_DEBUG_ASSERT(dest_column_i < _recovery_rows);
-        uint8_t * GF256_RESTRICT dest = _recovery_blocks + _block_bytes * dest_column_i;
+        uint8_t * GF256_RESTRICT dest = recovery_blocks + _block_bytes * dest_column_i;
 
         CAT_IF_DUMP(cout << "Generating column " << dest_column_i << ":";)
 
-        const uint8_t * GF256_RESTRICT input_src = _input_blocks + _block_bytes * row_i;
+        const uint8_t * GF256_RESTRICT input_src = input_blocks + _block_bytes * row_i;
         CAT_IF_DUMP(cout << " " << row_i << ":[" << (unsigned)input_src[0] << "]";)
 
         const RowMixIterator mix(row->Params, _mix_count, _mix_next_prime);
 
         // Set up mixing column generator
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[0]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[0]);
+        const uint8_t * GF256_RESTRICT src = recovery_blocks + _block_bytes * (_block_count + mix.Columns[0]);
 
         // If copying from final block:
         if (row_i != _block_count - 1) {
-            gf256_addset_mem(dest, src, input_src, _block_bytes);
+            gf256_addset_mem(dest, src, input_src, bytes);
         }
         else
         {
-            gf256_addset_mem(dest, src, input_src, _input_final_bytes);
+            // Part of the final block that is in this stripe
+            const unsigned input_bytes = _input_final_bytes <= offset ? 0 :
+                (_input_final_bytes - offset < bytes ? _input_final_bytes - offset : bytes);
+
+            if (input_bytes > 0) {
+                gf256_addset_mem(dest, src, input_src, input_bytes);
+            }
             memcpy(
-                dest + _input_final_bytes,
-                src + _input_final_bytes,
-                _block_bytes - _input_final_bytes);
+                dest + input_bytes,
+                src + input_bytes,
+                bytes - input_bytes);
         }
         CAT_IF_ROWOP(++rowops;)
 
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[1]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src0 = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[1]);
+        const uint8_t * GF256_RESTRICT src0 = recovery_blocks + _block_bytes * (_block_count + mix.Columns[1]);
         CAT_DEBUG_ASSERT((unsigned)(_block_count + mix.Columns[2]) < _recovery_rows);
-        const uint8_t * GF256_RESTRICT src1 = _recovery_blocks + _block_bytes * (_block_count + mix.Columns[2]);
+        const uint8_t * GF256_RESTRICT src1 = recovery_blocks + _block_bytes * (_block_count + mix.Columns[2]);
 
         // Add next two mixing columns in
-        gf256_add2_mem(dest, src0, src1, _block_bytes);
+        gf256_add2_mem(dest, src0, src1, bytes);
 
         CAT_IF_ROWOP(++rowops;)
 
@@ -2787,20 +2850,20 @@ void Codec::Substitute()
             if (column_0 != dest_column_i)
             {
                 CAT_DEBUG_ASSERT(column_0 < _recovery_rows);
-                const uint8_t * GF256_RESTRICT peel0 = _recovery_blocks + _block_bytes * column_0;
+                const uint8_t * GF256_RESTRICT peel0 = recovery_blocks + _block_bytes * column_0;
 
                 // Common case:
                 if (column_1 != dest_column_i) {
                     CAT_DEBUG_ASSERT(column_1 < _recovery_rows);
-                    gf256_add2_mem(dest, peel0, _recovery_blocks + _block_bytes * column_1, _block_bytes);
+                    gf256_add2_mem(dest, peel0, recovery_blocks + _block_bytes * column_1, bytes);
                 }
                 else {
-                    gf256_add_mem(dest, peel0, _block_bytes);
+                    gf256_add_mem(dest, peel0, bytes);
                 }
             }
             else {
                 CAT_DEBUG_ASSERT(column_1 < _recovery_rows);
-                gf256_add_mem(dest, _recovery_blocks + _block_bytes * column_1, _block_bytes);
+                gf256_add_mem(dest, recovery_blocks + _block_bytes * column_1, bytes);
             }
             CAT_IF_ROWOP(++rowops;)
 
@@ -2809,14 +2872,14 @@ void Codec::Substitute()
             {
                 const uint16_t column_i = iter.GetColumn();
                 CAT_DEBUG_ASSERT(column_i < _recovery_rows);
-                const uint8_t * GF256_RESTRICT peel_src = _recovery_blocks + _block_bytes * column_i;
+                const uint8_t * GF256_RESTRICT peel_src = recovery_blocks + _block_bytes * column_i;
 
                 CAT_IF_DUMP(cout << " " << column_i;)
 
                 // If column is not the solved one:
                 if (column_i != dest_column_i)
                 {
-                    gf256_add_mem(dest, peel_src, _block_bytes);
+                    gf256_add_mem(dest, peel_src, bytes);
                     CAT_IF_ROWOP(++rowops;)
                     CAT_IF_DUMP(cout << "[" << (unsigned)peel_src[0] << "]";)
                 }
@@ -2951,13 +3014,303 @@ WirehairResult Codec::SolveMatrix()
     return Wirehair_Success;
 }
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+
+// Shared by the encoders of all threads, most recently used first
+static std::mutex m_solved_lock;
+static std::list<std::shared_ptr<const SolvedMatrix>> m_solved;
+static uint64_t m_solved_bytes = 0;
+
+void Codec::SaveSolvedMatrix()
+{
+    const uint32_t row_count = _block_count + _extra_count;
+    const uint8_t * GF256_RESTRICT peeling = reinterpret_cast<const uint8_t *>( _peel_rows );
+    const uint8_t * GF256_RESTRICT peeling_end = _copied_original + row_count;
+    const uint8_t * GF256_RESTRICT matrix = reinterpret_cast<const uint8_t *>( _compress_matrix );
+    const uint8_t * GF256_RESTRICT matrix_end = reinterpret_cast<const uint8_t *>( _ge_col_map + _ge_cols );
+
+    std::shared_ptr<SolvedMatrix> solved = std::make_shared<SolvedMatrix>();
+    solved->BlockCount = _block_count;
+    solved->DenseCount = _dense_count;
+    solved->PSeed = _p_seed;
+    solved->DSeed = _d_seed;
+    solved->PeelHeadRows = _peel_head_rows;
+    solved->DeferHeadColumns = _defer_head_columns;
+    solved->DeferHeadRows = _defer_head_rows;
+    solved->DeferCount = _defer_count;
+    solved->PivotCount = _pivot_count;
+    solved->NextPivot = _next_pivot;
+    solved->FirstHeavyPivot = _first_heavy_pivot;
+    solved->Peeling.assign(peeling, peeling_end);
+    solved->Matrix.assign(matrix, matrix_end);
+
+    const uint64_t bytes = solved->Peeling.size() + solved->Matrix.size();
+    if (bytes > CAT_SOLVED_MATRIX_CACHE_BYTES) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> locker(m_solved_lock);
+
+    // Another thread may have solved it in the meantime
+    for (const auto& other : m_solved)
+    {
+        if (other->BlockCount == _block_count && other->DenseCount == _dense_count &&
+            other->PSeed == _p_seed && other->DSeed == _d_seed)
+        {
+            return;
+        }
+    }
+
+    m_solved.push_front(std::move(solved));
+    m_solved_bytes += bytes;
+
+    while (m_solved_bytes > CAT_SOLVED_MATRIX_CACHE_BYTES)
+    {
+        const SolvedMatrix& last = *m_solved.back();
+        m_solved_bytes -= last.Peeling.size() + last.Matrix.size();
+        m_solved.pop_back();
+    }
+}
+
+bool Codec::RestoreSolvedMatrix()
+{
+    std::shared_ptr<const SolvedMatrix> solved;
+    {
+        std::lock_guard<std::mutex> locker(m_solved_lock);
+
+        for (auto it = m_solved.begin(); it != m_solved.end(); ++it)
+        {
+            const SolvedMatrix& other = **it;
+            if (other.BlockCount == _block_count && other.DenseCount == _dense_count &&
+                other.PSeed == _p_seed && other.DSeed == _d_seed)
+            {
+                m_solved.splice(m_solved.begin(), m_solved, it);
+                solved = *it;
+                break;
+            }
+        }
+    }
+
+    if (!solved) {
+        return false;
+    }
+
+    _peel_head_rows = solved->PeelHeadRows;
+    _defer_head_columns = solved->DeferHeadColumns;
+    _defer_head_rows = solved->DeferHeadRows;
+    _defer_count = solved->DeferCount;
+
+    // Sets the matrix pointers for this defer count
+    if (!AllocateMatrix()) {
+        return false;
+    }
+
+    const uint32_t row_count = _block_count + _extra_count;
+    uint8_t * GF256_RESTRICT peeling = reinterpret_cast<uint8_t *>( _peel_rows );
+    uint8_t * GF256_RESTRICT matrix = reinterpret_cast<uint8_t *>( _compress_matrix );
+    CAT_DEBUG_ASSERT(peeling + solved->Peeling.size() == _copied_original + row_count);
+    CAT_DEBUG_ASSERT(matrix + solved->Matrix.size() == reinterpret_cast<uint8_t *>( _ge_col_map + _ge_cols ));
+    memcpy(peeling, solved->Peeling.data(), solved->Peeling.size());
+    memcpy(matrix, solved->Matrix.data(), solved->Matrix.size());
+
+    _pivot_count = solved->PivotCount;
+    _next_pivot = solved->NextPivot;
+    _first_heavy_pivot = solved->FirstHeavyPivot;
+
+    // PeelDiagonal() marks the rows it has copied a block value into
+    for (uint16_t peel_row_i = _peel_head_rows;
+        peel_row_i != LIST_TERM;
+        peel_row_i = _peel_rows[peel_row_i].NextRow)
+    {
+        _peel_rows[peel_row_i].Marks.Result.IsCopied = 0;
+    }
+
+    return true;
+}
+
+#endif // CAT_REUSE_SOLVED_MATRIX
+
+#if defined(CAT_STRIPED_VALUES)
+
+/**
+    StripeWorkers
+
+    Threads shared by all codecs, started once by SetStripeThreads(), that
+    solve the stripes of block values the codecs hand them.  A codec takes
+    back the stripes no worker has started yet, so a solve never waits on
+    workers busy with other codecs.
+*/
+class StripeWorkers
+{
+public:
+    ~StripeWorkers()
+    {
+        Resize(0);
+    }
+
+    /// Stops the workers there are and starts count new ones
+    void Resize(unsigned count)
+    {
+        std::lock_guard<std::mutex> resizing(_resize_lock);
+
+        std::vector<std::thread> stopped;
+        {
+            std::lock_guard<std::mutex> locker(_lock);
+            _stopping = true;
+            stopped.swap(_threads);
+        }
+        _work.notify_all();
+        for (std::thread& thread : stopped) {
+            thread.join();
+        }
+
+        std::lock_guard<std::mutex> locker(_lock);
+        _stopping = false;
+        for (unsigned ii = 0; ii < count; ++ii)
+        {
+            try {
+                _threads.emplace_back(&StripeWorkers::Run, this);
+            }
+            catch (const std::system_error&) {
+                break; // Out of threads: make do with fewer
+            }
+        }
+    }
+
+    /// Number of stripes to split a solve into: one per worker plus the caller
+    unsigned StripeCount() const
+    {
+        std::lock_guard<std::mutex> locker(_lock);
+        return (unsigned)_threads.size() + 1;
+    }
+
+    /**
+        Solve()
+
+        Solves the stripes of the codec after the first on the workers and
+        the first on the calling thread, returns once all of them are done.
+    */
+    void Solve(Codec* codec, unsigned block_bytes, unsigned stripe_bytes)
+    {
+        Batch batch;
+        {
+            std::lock_guard<std::mutex> locker(_lock);
+            for (unsigned offset = stripe_bytes; offset < block_bytes; offset += stripe_bytes)
+            {
+                const unsigned bytes = block_bytes - offset < stripe_bytes ? block_bytes - offset : stripe_bytes;
+                _queue.push_back({ codec, offset, bytes, &batch });
+                ++batch.Remaining;
+            }
+        }
+        _work.notify_all();
+
+        codec->GenerateRecoveryStripe(0, stripe_bytes);
+
+        std::unique_lock<std::mutex> locker(_lock);
+        for (auto it = _queue.begin(); it != _queue.end();)
+        {
+            if (it->Owner != &batch) {
+                ++it;
+                continue;
+            }
+            const Stripe stripe = *it;
+            it = _queue.erase(it);
+            locker.unlock();
+            codec->GenerateRecoveryStripe(stripe.Offset, stripe.Bytes);
+            locker.lock();
+            --batch.Remaining;
+            it = _queue.begin(); // Workers may have changed it
+        }
+        _done.wait(locker, [&batch] { return batch.Remaining == 0; });
+    }
+
+private:
+    /// Stripes of one solve that are not done yet
+    struct Batch
+    {
+        unsigned Remaining = 0;
+    };
+
+    struct Stripe
+    {
+        Codec* Solver;
+        unsigned Offset, Bytes;
+        Batch* Owner;
+    };
+
+    std::mutex _resize_lock;
+    mutable std::mutex _lock;
+    std::condition_variable _work, _done;
+    std::deque<Stripe> _queue;
+    std::vector<std::thread> _threads;
+    bool _stopping = false;
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> locker(_lock);
+        for (;;)
+        {
+            _work.wait(locker, [this] { return _stopping || !_queue.empty(); });
+            if (_stopping) {
+                return; // Queued stripes are taken back by their codecs
+            }
+
+            const Stripe stripe = _queue.front();
+            _queue.pop_front();
+            locker.unlock();
+            stripe.Solver->GenerateRecoveryStripe(stripe.Offset, stripe.Bytes);
+            locker.lock();
+            if (--stripe.Owner->Remaining == 0) {
+                _done.notify_all();
+            }
+        }
+    }
+};
+
+static StripeWorkers m_stripe_workers;
+
+#endif // CAT_STRIPED_VALUES
+
+void Codec::SetStripeThreads(unsigned threads)
+{
+#if defined(CAT_STRIPED_VALUES)
+    m_stripe_workers.Resize(threads > 1 ? threads - 1 : 0);
+#else
+    (void)threads;
+#endif // CAT_STRIPED_VALUES
+}
+
 void Codec::GenerateRecoveryBlocks()
 {
     InitializeColumnValues();
-    MultiplyDenseValues();
-    AddSubdiagonalValues();
-    BackSubstituteAboveDiagonal();
-    Substitute();
+
+#if defined(CAT_STRIPED_VALUES)
+    unsigned stripes = m_stripe_workers.StripeCount();
+    if (stripes > _block_bytes / CAT_MIN_STRIPE_BYTES) {
+        stripes = _block_bytes / CAT_MIN_STRIPE_BYTES;
+    }
+    if (_block_count < CAT_MIN_STRIPED_N) {
+        stripes = 1;
+    }
+
+    if (stripes > 1)
+    {
+        // Whole cache lines in each stripe, the last one gets the rest
+        const unsigned stripe_bytes = ((_block_bytes + stripes - 1) / stripes + 63) & ~63u;
+        m_stripe_workers.Solve(this, _block_bytes, stripe_bytes);
+        return;
+    }
+#endif // CAT_STRIPED_VALUES
+
+    GenerateRecoveryStripe(0, _block_bytes);
+}
+
+void Codec::GenerateRecoveryStripe(unsigned offset, unsigned bytes)
+{
+    MultiplyDenseValues(offset, bytes);
+    AddSubdiagonalValues(offset, bytes);
+    BackSubstituteAboveDiagonal(offset, bytes);
+    Substitute(offset, bytes);
 }
 
 WirehairResult Codec::ResumeSolveMatrix(
@@ -3077,7 +3430,7 @@ WirehairResult Codec::ResumeSolveMatrix(
         PeelColumn * GF256_RESTRICT ref_col = &_peel_cols[column];
 
         // If column is peeled:
-        if (ref_col->Mark == MARK_PEEL)
+        if (_peel_col_marks[column] == MARK_PEEL)
         {
             const unsigned row_k = ref_col->PeelRow;
             const uint64_t * GF256_RESTRICT ge_src_row = _compress_matrix + _ge_pitch * row_k;
@@ -3756,6 +4109,9 @@ bool Codec::AllocateWorkspace()
         + sizeof(PeelRow) * row_count
         + sizeof(PeelColumn) * column_count
         + sizeof(PeelRefs) * column_count
+        + sizeof(uint16_t) * column_count * 2
+        + sizeof(uint16_t) * row_count
+        + column_count
         + row_count;
 
     if (_workspace_allocated < sizeBytes)
@@ -3774,7 +4130,11 @@ bool Codec::AllocateWorkspace()
     _peel_rows = reinterpret_cast<PeelRow *>( _recovery_blocks + recoverySizeBytes );
     _peel_cols = reinterpret_cast<PeelColumn *>( _peel_rows + row_count );
     _peel_col_refs = reinterpret_cast<PeelRefs *>( _peel_cols + column_count );
-    _copied_original = reinterpret_cast<uint8_t *>( _peel_col_refs + column_count );
+    _peel_col_ref_counts = reinterpret_cast<uint16_t *>( _peel_col_refs + column_count );
+    _peel_col_weight2_refs = _peel_col_ref_counts + column_count;
+    _peel_row_unmarked = _peel_col_weight2_refs + column_count;
+    _peel_col_marks = reinterpret_cast<uint8_t *>( _peel_row_unmarked + row_count );
+    _copied_original = _peel_col_marks + column_count;
 
     _recovery_rows = recovery_rows;
 
@@ -3783,9 +4143,9 @@ bool Codec::AllocateWorkspace()
     // Initialize columns
     for (unsigned ii = 0; ii < _block_count; ++ii)
     {
-        _peel_col_refs[ii].RowCount = 0;
-        _peel_cols[ii].Weight2Refs = 0;
-        _peel_cols[ii].Mark = MARK_TODO;
+        _peel_col_ref_counts[ii] = 0;
+        _peel_col_weight2_refs[ii] = 0;
+        _peel_col_marks[ii] = MARK_TODO;
     }
 
     return true;
@@ -4013,6 +4373,16 @@ WirehairResult Codec::EncodeFeed(const void * GF256_RESTRICT message_in)
 
     SetInput(message_in);
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+    // If the matrix for this N is known, only block values are left to compute:
+    if (RestoreSolvedMatrix())
+    {
+        PeelDiagonal(true);
+        GenerateRecoveryBlocks();
+        return Wirehair_Success;
+    }
+#endif // CAT_REUSE_SOLVED_MATRIX
+
     // For each input row:
     for (uint16_t id = 0; id < _block_count; ++id) {
         if (!OpportunisticPeeling(id, id)) {
@@ -4024,6 +4394,9 @@ WirehairResult Codec::EncodeFeed(const void * GF256_RESTRICT message_in)
     WirehairResult result = SolveMatrix();
 
     if (result == Wirehair_Success) {
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+        SaveSolvedMatrix();
+#endif // CAT_REUSE_SOLVED_MATRIX
         GenerateRecoveryBlocks();
         return Wirehair_Success;
     }
@@ -210,6 +210,10 @@
 
 #include "WirehairTools.h"
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+#include <vector>
+#endif
+
 namespace wirehair {
 
 
@@ -238,7 +242,15 @@ union PeelOverlappingFields
     PeelRowResult Result;
 };
 
-/// Row in the sparse matrix
+/**
+    Row in the sparse matrix
+
+    The fields that every avalanche step and every GreedyPeeling() scan
+    touch live in parallel arrays of their own instead (Codec::
+    _peel_row_unmarked, _peel_col_marks, _peel_col_ref_counts and
+    _peel_col_weight2_refs), so that they stay in cache for N in the tens
+    of thousands and the scan can be vectorized.
+*/
 struct PeelRow
 {
     /// Row PRNG seed that generates the set of columns included in this row
@@ -250,9 +262,6 @@ struct PeelRow
     /// Row parameters
     PeelRowParameters Params;
 
-    /// Count of columns that have not been marked yet
-    uint16_t UnmarkedCount;
-
     /// Marks left on this row
     PeelOverlappingFields Marks;
 };
@@ -265,7 +274,7 @@ enum MarkTypes
     MARK_DEFER ///< Deferred to Gaussian elimination
 };
 
-/// Column in the sparse matrix
+/// Column in the sparse matrix, its mark is in Codec::_peel_col_marks
 struct PeelColumn
 {
     /// Linkage in column list
@@ -273,31 +282,61 @@ struct PeelColumn
 
     union
     {
-        /// Number of weight-2 rows containing this column
-        uint16_t Weight2Refs;
-
         /// Row that solves the column
         uint16_t PeelRow;
 
         /// Column that a deferred column is mapped to
         uint16_t GEColumn;
     };
-
-    /// One of the MarkTypes enumeration
-    uint8_t Mark;
 };
 
-/// List of rows referencing a column
+/// List of rows referencing a column, its length is in Codec::_peel_col_ref_counts
 struct PeelRefs
 {
-    /// Number of rows containing this column
-    uint16_t RowCount;
-
     /// Rows in this reference
     uint16_t Rows[CAT_REF_LIST_MAX];
 };
 
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+
+//------------------------------------------------------------------------------
+// Solved Matrix
+
+/**
+    An encoder is always given rows 0..N-1, so the matrix it solves depends
+    only on N and the seeds, not on the message.  Everything peeling,
+    compression and Gaussian elimination leave behind is recorded here the
+    first time an N is encoded.  Later encoders for the same N start from a
+    copy of it and only run the steps that compute block values.
+*/
+struct SolvedMatrix
+{
+    /// Matrix parameters, the cache key
+    uint16_t BlockCount;
+    uint16_t DenseCount;
+    uint32_t PSeed;
+    uint32_t DSeed;
+
+    /// Codec state
+    uint16_t PeelHeadRows;
+    uint16_t DeferHeadColumns;
+    uint16_t DeferHeadRows;
+    uint16_t DeferCount;
+    unsigned PivotCount;
+    unsigned NextPivot;
+    unsigned FirstHeavyPivot;
+
+    /// Peeling rows, columns and references
+    std::vector<uint8_t> Peeling;
+
+    /// Compression, GE and heavy matrices with the pivots
+    std::vector<uint8_t> Matrix;
+};
+
+#endif // CAT_REUSE_SOLVED_MATRIX
+
+
 //------------------------------------------------------------------------------
 // Codec
 
@@ -380,6 +419,18 @@ class Codec
     /// List of column references
     PeelRefs * GF256_RESTRICT _peel_col_refs = nullptr;
 
+    /// Array of N counts of rows containing each column
+    uint16_t * GF256_RESTRICT _peel_col_ref_counts = nullptr;
+
+    /// Array of N counts of weight-2 rows containing each column
+    uint16_t * GF256_RESTRICT _peel_col_weight2_refs = nullptr;
+
+    /// Array of N counts of columns in each row that have not been marked yet
+    uint16_t * GF256_RESTRICT _peel_row_unmarked = nullptr;
+
+    /// Array of N column marks, one of the MarkTypes enumeration
+    uint8_t * GF256_RESTRICT _peel_col_marks = nullptr;
+
     /// Tail of peeling solved rows list
     PeelRow * GF256_RESTRICT _peel_tail_rows = nullptr;
 
@@ -720,8 +771,11 @@ class Codec
                 Add Compression matrix row to referencing row.
                 If row is peeled,
                     Add row block value.
+
+        With values_only set the Compression matrix is left alone, for an
+        encoder that restored it from a SolvedMatrix.
     */
-    void PeelDiagonal();
+    void PeelDiagonal(bool values_only = false);
 
     /**
         CopyDeferredRows()
@@ -1026,6 +1080,13 @@ class Codec
     */
     void InitializeColumnValues();
 
+    /*
+        The functions below apply the same row operations at every byte
+        offset of the block values, so they work on a stripe of them:
+        the bytes [offset, offset + bytes) of every row.  Different stripes
+        can be solved at the same time, see GenerateRecoveryStripe().
+    */
+
     /**
         MultiplyDenseValues()
 
@@ -1037,7 +1098,7 @@ class Codec
         See MultiplyDenseRows() comments for justification of the
         design of the dense row structure.
     */
-    void MultiplyDenseValues();
+    void MultiplyDenseValues(unsigned offset, unsigned bytes);
 
     /**
         AddSubdiagonalValues()
@@ -1048,7 +1109,7 @@ class Codec
         It is aided by the already roughly upper-triangular form
         of the GE matrix, making this function very cheap to execute.
     */
-    void AddSubdiagonalValues();
+    void AddSubdiagonalValues(unsigned offset, unsigned bytes);
 
     /**
         Windowed Back-Substitution
@@ -1124,7 +1185,7 @@ class Codec
         to eliminate all of the bits in the upper triangular half,
         completing solving for these columns.
     */
-    void BackSubstituteAboveDiagonal();
+    void BackSubstituteAboveDiagonal(unsigned offset, unsigned bytes);
 
     /**
         Substitute()
@@ -1143,7 +1204,7 @@ class Codec
         are so dense, it is actually faster in every case to just regenerate
         the rows from scratch and throw away those results.
     */
-    void Substitute();
+    void Substitute(unsigned offset, unsigned bytes);
 
 
     //--------------------------------------------------------------------------
@@ -1208,6 +1269,26 @@ class Codec
         const void * GF256_RESTRICT data ///< Block data
     );
 
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+    /**
+        SaveSolvedMatrix()
+
+        Called once SolveMatrix() succeeded for the N original rows of an
+        encoder.  Shares the solved matrix with later encoders for this N.
+    */
+    void SaveSolvedMatrix();
+
+    /**
+        RestoreSolvedMatrix()
+
+        Returns true if a matrix was solved for this N before.  The codec is
+        then in the state SolveMatrix() would have left it in, except that
+        the peeled rows' block values are not set yet: PeelDiagonal(true)
+        does that.
+    */
+    bool RestoreSolvedMatrix();
+#endif // CAT_REUSE_SOLVED_MATRIX
+
 #if defined(CAT_ALL_ORIGINAL)
     /**
         IsAllOriginalData()
@@ -1237,6 +1318,11 @@ public:
     ~Codec();
 
 
+    /// Threads that GenerateRecoveryBlocks() may use, for all codecs:
+    /// starts threads - 1 workers shared by them.  Defaults to 1
+    static void SetStripeThreads(unsigned threads);
+
+
     //--------------------------------------------------------------------------
     // Getters
 
@@ -1333,9 +1419,15 @@ public:
             Solves remaining columns:
 
                 Substitute()
+
+        InitializeColumnValues() runs first, the rest is split into stripes
+        of the block values solved on up to SetStripeThreads() threads.
     */
     void GenerateRecoveryBlocks();
 
+    /// Solves the block values from MultiplyDenseValues() on for a stripe
+    void GenerateRecoveryStripe(unsigned offset, unsigned bytes);
+
     /**
         ReconstructOutput()
 
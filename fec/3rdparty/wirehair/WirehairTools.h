@@ -66,6 +66,8 @@ namespace wirehair {
 #define CAT_MAX_EXTRA_ROWS 32    /**< Maximum number of extra rows to support before reusing existing rows */
 #define CAT_WIREHAIR_MAX_N 64000 /**< Largest N value to allow */
 #define CAT_WIREHAIR_MIN_N 2     /**< Smallest N value to allow */
+#define CAT_MIN_STRIPE_BYTES 256 /**< Narrowest stripe of block values given its own thread */
+#define CAT_MIN_STRIPED_N  256   /**< Smallest N value to solve on several threads */
 
 // Optimization options:
 #define CAT_COPY_FIRST_N      /**< Copy the first N rows from the input (faster) */
@@ -73,6 +75,12 @@ namespace wirehair {
 #define CAT_WINDOWED_BACKSUB  /**< Use window optimization for back-substitution (faster) */
 #define CAT_WINDOWED_LOWERTRI /**< Use window optimization for lower triangle elimination (faster) */
 #define CAT_ALL_ORIGINAL      /**< Avoid doing calculations for 0 losses -- Requires CAT_COPY_FIRST_N (faster) */
+#define CAT_REUSE_SOLVED_MATRIX /**< Encoders reuse the matrix solved for the same N (faster) */
+#define CAT_STRIPED_VALUES    /**< Solve block values on several threads, see wirehair_set_stripe_threads() (faster) */
+
+#if defined(CAT_REUSE_SOLVED_MATRIX)
+#define CAT_SOLVED_MATRIX_CACHE_BYTES (64 * 1024 * 1024) /**< Memory for solved matrices, least recently used dropped first */
+#endif
 
 /// Number of heavy rows at the bottom of the matrix
 static const unsigned kHeavyRows = 6;
@@ -242,6 +242,13 @@ WIREHAIR_EXPORT WirehairResult wirehair_decoder_becomes_encoder(
     return encoder->InitializeEncoderFromDecoder();
 }
 
+WIREHAIR_EXPORT void wirehair_set_stripe_threads(
+    unsigned threads ///< Threads per codec
+)
+{
+    wirehair::Codec::SetStripeThreads(threads);
+}
+
 WIREHAIR_EXPORT void wirehair_free(
     WirehairCodec codec ///< Codec object to free
 )
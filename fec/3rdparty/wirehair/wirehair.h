@@ -304,6 +304,19 @@ WIREHAIR_EXPORT WirehairResult wirehair_decoder_becomes_encoder(
     WirehairCodec codec ///< Codec to change
 );
 
+/**
+    wirehair_set_stripe_threads()
+
+    Let each codec solve its block values on up to this many threads, each
+    taking a stripe of the bytes of every block.  Only pays off for large
+    N and blocks of at least a few hundred bytes; smaller ones stay on the
+    calling thread.  Starts threads - 1 worker threads, shared by all codecs,
+    so call it once at startup rather than per codec.  Default: 1
+*/
+WIREHAIR_EXPORT void wirehair_set_stripe_threads(
+    unsigned threads ///< Threads per codec, 0 is the same as 1
+);
+
 /**
     wirehair_free()
 
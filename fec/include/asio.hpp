@@ -2,7 +2,10 @@
 
 #include <boost/asio.hpp>
 
+#include <map>
+
 #include "logic.hpp"
+#include "packet.hpp"
 #include "utility.hpp"
 
 unsigned const NETWORK_BUFFER_SIZE = 5000;
@@ -60,13 +63,42 @@ public:
     void queue_packet(Bytes packet)
     {
         bool was_empty = m_queue.empty();
-        m_queue.push(std::move(packet));
+        std::uint64_t const priority = packet_priority(packet);
+        m_queue.push(std::move(packet), priority);
         if(was_empty)
         {
             maybe_send();
         }
     }
 
+    // Packets are pulled from source as the shaper allows.
+    // Tag block sources with block_tag() so that cancel_block() finds them,
+    // and give them their block_packet_priority().
+    void add_source(PacketSource source, std::uint64_t tag = 0,
+        std::uint64_t priority = 0)
+    {
+        bool was_empty = m_queue.empty();
+        m_queue.add_source(std::move(source), tag, priority);
+        if(was_empty)
+        {
+            maybe_send();
+        }
+    }
+
+    // Drops everything queued for a block, e.g. once the peer has decoded it
+    // or the block has expired
+    void cancel_block(std::uint32_t channel_id, std::uint32_t block_id)
+    {
+        m_queue.drop([=](Bytes const& packet) {
+            auto const* h = reinterpret_cast<BlockPacketHeader const *>(
+                packet.data());
+            return
+                h->m_packet_type == PacketHeader::PacketType::BLOCK &&
+                h->m_channel_id == channel_id &&
+                h->m_block_id == block_id;
+        }, block_tag(channel_id, block_id));
+    }
+
     void maybe_send()
     {
         time_point_t now = Clock::now();
@@ -74,7 +106,10 @@ public:
 
         while((next = m_queue.when_can_pop()) <= now)
         {
-            m_send(m_queue.pop_value(now));
+            if(auto packet = m_queue.pop_value(now))
+            {
+                m_send(std::move(*packet));
+            }
         }
 
         if(next == FAR_FUTURE)
@@ -84,6 +119,11 @@ public:
 
         m_timer.expires_at(next);
         m_timer.async_wait([&](error_code ec) {
+            // Rescheduled by queue_packet after the queue ran dry early
+            if(ec == asio::error::operation_aborted)
+            {
+                return;
+            }
             enforce_ec(ec);
             maybe_send();
         });
@@ -92,7 +132,7 @@ public:
 private:
     std::function<void(Bytes)> m_send;
     ShapedPacketQueue m_queue;
-    Timer m_timer;  // A wait is pending iff queue not empty.
+    Timer m_timer;  // A wait is pending if queue not empty.
 };
 
 template <class Derived>
@@ -111,9 +151,19 @@ public:
 
     void send_bytes(udp::endpoint endpoint, Bytes bytes)
     {
+        if(bytes.size() >= sizeof(PacketHeader))
+        {
+            reinterpret_cast<PacketHeader *>(bytes.data())->m_seq =
+                link(endpoint).next_seq();
+        }
         ::send_bytes(m_socket, endpoint, std::move(bytes));
     }
 
+    LinkMonitor& link(udp::endpoint endpoint)
+    {
+        return m_links[endpoint];
+    }
+
     AsioReceiver make_receiver(udp::endpoint endpoint, unsigned kbps)
     {
         return AsioReceiver(m_io_context, [this, endpoint](Bytes packet) {
@@ -146,6 +196,7 @@ private:
     udp::socket m_socket;
     udp::endpoint m_peer;
     std::vector<char> m_buffer;
+    std::map<udp::endpoint, LinkMonitor> m_links;  // References stay valid
 
     Derived& as_derived()
     {
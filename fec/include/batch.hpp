@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "asio.hpp"
+#include "utility.hpp"
+
+// Small objects sent as one block (BlockContent::BATCH), so that they share
+// the codec setup, the block state and the padding of the last symbol.
+// Layout: object count, the end offset of each object counted from the
+// first one, then the objects back to back. All uint32, native byte order.
+
+inline std::size_t batch_size(std::size_t n_objects, std::size_t object_bytes)
+{
+    return (1 + n_objects) * sizeof(std::uint32_t) + object_bytes;
+}
+
+inline Bytes pack_batch(std::vector<Bytes> const& objects)
+{
+    std::vector<std::uint32_t> index{std::uint32_t(objects.size())};
+    std::uint32_t end = 0;
+    for(auto const& object : objects)
+    {
+        end += object.size();
+        index.push_back(end);
+    }
+
+    Bytes batch(batch_size(objects.size(), end));
+    std::memcpy(batch.data(), index.data(), index.size() * sizeof(index[0]));
+    char* out = batch.data() + index.size() * sizeof(index[0]);
+    for(auto const& object : objects)
+    {
+        out = std::copy(object.begin(), object.end(), out);
+    }
+    return batch;
+}
+
+// The objects are slices of batch. Returns nullopt if batch isn't laid out
+// as above, it comes off the wire.
+inline std::optional<std::vector<std::string_view>> unpack_batch(
+    std::string_view batch)
+{
+    auto read = [&](std::size_t i) {
+        std::uint32_t value;
+        std::memcpy(&value, batch.data() + i * sizeof(value), sizeof(value));
+        return value;
+    };
+
+    std::size_t const n_words = batch.size() / sizeof(std::uint32_t);
+    if(n_words == 0)
+    {
+        return std::nullopt;
+    }
+    std::uint32_t const n_objects = read(0);
+    if(n_objects >= n_words)
+    {
+        return std::nullopt;
+    }
+    std::size_t const data = batch_size(n_objects, 0);
+
+    std::vector<std::string_view> objects;
+    std::uint32_t begin = 0;
+    for(std::uint32_t i = 0; i < n_objects; ++i)
+    {
+        std::uint32_t const end = read(1 + i);
+        if(end < begin || data + end > batch.size())
+        {
+            return std::nullopt;
+        }
+        objects.push_back(batch.substr(data + begin, end - begin));
+        begin = end;
+    }
+    return objects;
+}
+
+// Collects objects into batches. A batch is flushed once it reaches
+// max_bytes, or max_delay after its first object went in, whichever
+// comes first. An object that is over max_bytes by itself goes alone.
+class BlockBatcher
+{
+public:
+    using Flush = std::function<void(Bytes batch, std::uint32_t n_objects)>;
+
+    BlockBatcher(asio::io_context& io_context, std::size_t max_bytes,
+        std::chrono::milliseconds max_delay, Flush on_flush):
+        m_max_bytes(max_bytes),
+        m_max_delay(max_delay),
+        m_on_flush(std::move(on_flush)),
+        m_timer(io_context)
+    {
+    }
+
+    BlockBatcher(BlockBatcher const &) = delete;
+
+    void add(Bytes object)
+    {
+        if(!m_objects.empty() &&
+            batch_size(m_objects.size() + 1, m_bytes + object.size()) > m_max_bytes)
+        {
+            flush();
+        }
+
+        if(m_objects.empty())
+        {
+            m_timer.expires_after(m_max_delay);
+            m_timer.async_wait([this, batch = m_n_batches](error_code ec) {
+                // Flushed for size in the meantime
+                if(ec == asio::error::operation_aborted || batch != m_n_batches)
+                {
+                    return;
+                }
+                enforce_ec(ec);
+                flush();
+            });
+        }
+        m_bytes += object.size();
+        m_objects.push_back(std::move(object));
+
+        if(batch_size(m_objects.size(), m_bytes) >= m_max_bytes)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        if(m_objects.empty())
+        {
+            return;
+        }
+        m_timer.cancel();
+
+        Bytes batch = pack_batch(m_objects);
+        std::uint32_t const n_objects = m_objects.size();
+        m_objects.clear();
+        m_bytes = 0;
+        ++m_n_batches;
+        m_on_flush(std::move(batch), n_objects);
+    }
+
+private:
+    std::size_t m_max_bytes;
+    std::chrono::milliseconds m_max_delay;
+    Flush m_on_flush;
+    Timer m_timer;
+
+    std::vector<Bytes> m_objects;
+    std::size_t m_bytes = 0;
+    std::uint64_t m_n_batches = 0;  // Flushed
+};
@@ -1,51 +1,234 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <deque>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string_view>
 #include <vector>
 #include <utility>
 
 #include "fec.hpp"
+#include "sink.hpp"
 #include "utility.hpp"
 
+// A symbol of a block: sub-block number and symbol index within it
+struct SymbolId
+{
+    std::uint32_t sub_block;
+    std::uint32_t index;
+};
+
+// The symbol indices an upstream sends to a subscriber that gets the block
+// from several of them: those equal to slot modulo n_slots. Upstreams given
+// different slots never send the same symbol.
+struct SymbolPartition
+{
+    std::uint32_t slot = 0;
+    std::uint32_t n_slots = 1;
+};
+
+// How a block competes with the others, set by its publisher and carried in
+// every packet of the block. Newer blocks make older ones obsolete, so they
+// get a higher priority. Past its deadline (see wall_clock_ms()) a block is
+// dropped by every node; NO_DEADLINE never expires.
+struct BlockSchedule
+{
+    static std::uint32_t const NO_DEADLINE = 0;
+
+    std::uint32_t priority = 0;  // Higher goes first
+    std::uint32_t deadline_ms = NO_DEADLINE;
+
+    static BlockSchedule expiring_in(std::uint32_t priority,
+        std::chrono::milliseconds ttl)
+    {
+        std::uint32_t deadline = wall_clock_ms() + ttl.count();
+        return { priority, deadline == NO_DEADLINE ? 1 : deadline };
+    }
+
+    bool has_deadline() const
+    {
+        return deadline_ms != NO_DEADLINE;
+    }
+
+    bool expired(std::uint32_t now_ms) const
+    {
+        // The clock wraps around, deadlines are less than 24 days away
+        return has_deadline() && std::int32_t(now_ms - deadline_ms) >= 0;
+    }
+};
+
+// What the block data is, for the receiving application
+enum class BlockContent: std::uint32_t
+{
+    RAW,
+    BATCH,  // Small objects packed together, see batch.hpp
+};
+
+// A block is coded as one or more independent sub-blocks.
+// Blocks of up to MAX_SUB_BLOCK_SYMBOLS chunks are a single sub-block,
+// larger ones are split evenly so that the sub-blocks can be encoded and
+// decoded in parallel (and wirehair's limit on N doesn't cap the block size).
+// Both sides derive the split from the block size alone.
+// All sub-blocks use the same codec, the sending side picks it by size.
 class Block
 {
 public:
+    static std::uint32_t const MAX_SUB_BLOCK_SYMBOLS = 4096;
+
+    // Tag: construct the sending side without solving the encoders yet.
+    // Original chunks can be served right away, FEC symbols of a sub-block
+    // only after set_encoder(sb, make_encoder(sb)).
+    struct DeferEncoding {};
+
     Block(std::string_view data):
-        m_block_size(data.size()),
-        m_decoded(data.begin(), data.end()),
-        m_fec(data)
+        Block(data, DeferEncoding{})
+    {
+        for(std::uint32_t sb = 0; sb < n_sub_blocks(); ++sb)
+        {
+            set_encoder(sb, make_encoder(sb));
+        }
+    }
+
+    Block(std::string_view data, DeferEncoding):
+        Block(copy_of(data), data.size(), DeferEncoding{})
+    {
+    }
+
+    // Sending side over data the block doesn't copy, e.g. a MappedFile.
+    // data keeps its owner alive (see the shared_ptr aliasing constructor).
+    Block(std::shared_ptr<char const> data, std::uint32_t size, DeferEncoding):
+        m_block_size(size),
+        m_codec(BlockFec::choose_codec(size)),
+        // Never written to on the sending side
+        m_data(std::const_pointer_cast<char>(std::move(data))),
+        m_sub_blocks(split(m_block_size)),
+        m_prefix_chunks(m_sub_blocks.size()),
+        m_sub_blocks_left(0)
     {
     }
 
-    Block(std::uint32_t block_size):
+    Block(std::uint32_t block_size, BlockCodecId codec):
+        Block(block_size, codec, std::make_shared<MemoryBlockSink>(block_size))
+    {
+    }
+
+    // Receiving side, recovers the block into sink.
+    // Check supports() first, the size and codec come off the wire.
+    Block(std::uint32_t block_size, BlockCodecId codec,
+        std::shared_ptr<BlockSink> sink):
         m_block_size(block_size),
-        m_symbols_seen(block_size / MAX_BLOCK_PACKET_SIZE * 2), // some redundancy
-        m_fec(block_size)
+        m_codec(codec),
+        m_data(sink, sink->data()),
+        m_sink(std::move(sink)),
+        m_sub_blocks(split(block_size)),
+        m_prefix_chunks(m_sub_blocks.size()),
+        m_sub_blocks_left(m_sub_blocks.size())
+    {
+        for(auto& sb : m_sub_blocks)
+        {
+            sb.symbols_seen.resize(sb.n_original * 2); // some redundancy
+            sb.fec.emplace(sb.size, m_codec);
+        }
+    }
+
+    // Runs the encoder solve for a sub-block. Only reads the block data,
+    // so it may run on another thread while original chunks are being sent.
+    BlockFec make_encoder(std::uint32_t sub_block) const
+    {
+        auto const& sb = m_sub_blocks.at(sub_block);
+        return BlockFec(std::string_view(m_data.get() + sb.offset, sb.size),
+            m_codec);
+    }
+
+    void set_encoder(std::uint32_t sub_block, BlockFec fec)
+    {
+        m_sub_blocks.at(sub_block).fec.emplace(std::move(fec));
+    }
+
+    bool can_encode() const
     {
+        return decoded() && std::all_of(m_sub_blocks.begin(),
+            m_sub_blocks.end(), [](auto const& sb) { return sb.fec.has_value(); });
     }
 
-    bool process_symbol(std::string_view payload, std::size_t ix)
+    // Returns true when this symbol completes the whole block.
+    // Symbols of different sub-blocks may be processed concurrently,
+    // symbols of the same sub-block must not.
+    bool process_symbol(std::string_view payload, SymbolId id)
     {
-        if(!m_decoded.empty())
+        auto& sb = m_sub_blocks.at(id.sub_block);
+        if(sb.decoded)
+        {
+            return false;
+        }
+
+        if(id.index >= sb.symbols_seen.size())
+        {
+            sb.symbols_seen.resize(std::max<std::size_t>(id.index + 1,
+                sb.symbols_seen.size() * 2));
+        }
+        if(sb.symbols_seen[id.index])
         {
+            // Wirehair must not be given the same symbol twice
             return false;
         }
+        sb.symbols_seen[id.index] = true;
 
-        if(ix >= m_symbols_seen.size())
+        // Original chunks go to their destination right away
+        if(id.index < sb.n_original)
         {
-            m_symbols_seen.resize(std::max(ix + 1, m_symbols_seen.size() * 2));
+            auto [offset, size] = chunk_extent(sb, id.index);
+            std::copy_n(payload.begin(), std::min<std::size_t>(size, payload.size()),
+                m_data.get() + offset);
+            advance_prefix(id.sub_block);
         }
-        m_symbols_seen[ix] = true;
 
-        auto res = m_fec.process_symbol(payload, ix);
-        if(!res.empty())
+        if(!sb.fec->process_symbol(payload, id.index))
         {
-            m_decoded = std::move(res);
-            return true;
+            return false;
+        }
+
+        // Only the original chunks that didn't arrive need recovering
+        bool const any_original = std::find(sb.symbols_seen.begin(),
+            sb.symbols_seen.begin() + sb.n_original, true) !=
+            sb.symbols_seen.begin() + sb.n_original;
+        if(!any_original)
+        {
+            sb.fec->recover(m_data.get() + sb.offset);
+        }
+        else
+        {
+            for(std::uint32_t ix = 0; ix < sb.n_original; ++ix)
+            {
+                if(!sb.symbols_seen[ix])
+                {
+                    sb.fec->recover_chunk(ix,
+                        m_data.get() + chunk_extent(sb, ix).first);
+                }
+            }
+        }
+        sb.fec->become_encoder();
+        sb.decoded = true;
+        m_prefix_chunks[id.sub_block].store(sb.n_original, std::memory_order_release);
+
+        if(--m_sub_blocks_left > 0)
+        {
+            return false;
+        }
+        if(m_sink)
+        {
+            m_sink->finish();
         }
-        return false;
+        return true;
+    }
+
+    bool decoded() const
+    {
+        return m_sub_blocks_left == 0;
     }
 
     auto block_size() const
@@ -53,113 +236,219 @@ public:
         return m_block_size;
     }
 
-    std::uint32_t n_original() const
+    BlockCodecId codec() const
     {
-        return (m_block_size + MAX_BLOCK_PACKET_SIZE - 1) / MAX_BLOCK_PACKET_SIZE;
+        return m_codec;
     }
 
-    auto const& decoded_data() const
+    BlockContent content() const
     {
-        return m_decoded;
+        return m_content;
     }
 
-    class BlockGenerator
+    // Before the block is shared with other threads
+    void set_content(BlockContent content)
     {
-    public:
-        using result_type = std::pair<Bytes, std::uint32_t>;
+        m_content = content;
+    }
 
-        BlockGenerator(Block& block): m_block(&block)
-        {
-        }
+    BlockSchedule const& schedule() const
+    {
+        return m_schedule;
+    }
+
+    // Before the block is shared with other threads
+    void set_schedule(BlockSchedule schedule)
+    {
+        m_schedule = schedule;
+    }
 
-        result_type operator()()
+    // Rough memory held by the block: its data, plus about as much again
+    // for each encoder (wirehair keeps its intermediate symbols)
+    std::uint64_t footprint() const
+    {
+        std::uint64_t bytes = m_block_size;
+        for(auto const& sb : m_sub_blocks)
         {
-            while(m_index < m_block->m_symbols_seen.size() &&
-                m_block->m_symbols_seen[m_index])
+            bytes += sb.symbols_seen.capacity() / 8;
+            if(sb.fec)
             {
-                ++m_index;
+                bytes += sb.size;
             }
+        }
+        return bytes;
+    }
 
-            struct Incrementer {
-                std::uint32_t& x;
-                ~Incrementer() {
-                    ++x;
-                }
-            } incrementer{m_index};
+    // Whether codec can code every sub-block of a block of this size
+    static bool supports(BlockCodecId codec, std::uint32_t block_size)
+    {
+        auto const sub_blocks = split(block_size);
+        return std::all_of(sub_blocks.begin(), sub_blocks.end(),
+            [codec](SubBlock const& sb) {
+                return BlockFec::supports(codec, sb.size);
+            });
+    }
 
-            if(m_index < m_block->n_original())
-            {
-                std::uint32_t ix_first = m_index * MAX_BLOCK_PACKET_SIZE;
-                std::uint32_t ix_last = std::min(m_block->m_block_size,
-                    (m_index + 1) * MAX_BLOCK_PACKET_SIZE);
+    std::uint32_t n_original() const
+    {
+        return (m_block_size + MAX_BLOCK_PACKET_SIZE - 1) / MAX_BLOCK_PACKET_SIZE;
+    }
 
-                return {{m_block->m_decoded.begin() + ix_first,
-                    m_block->m_decoded.begin() + ix_last}, m_index};
-            }
-            else
-            {
-                return {m_block->m_fec.get_symbol_data(m_index), m_index};
-            }
+    // Original chunks of each sub-block, for a block of this size
+    static std::vector<std::uint32_t> n_originals(std::uint32_t block_size)
+    {
+        std::vector<std::uint32_t> result;
+        for(auto const& sb : split(block_size))
+        {
+            result.push_back(sb.n_original);
         }
+        return result;
+    }
 
-    private:
-        Block* m_block;
-        std::uint32_t m_index = 0;
-    };
-
-    class BlockGeneratorIterator: public boost::iterator_facade<
-        BlockGeneratorIterator, 
-        BlockGenerator::result_type,
-        boost::single_pass_traversal_tag,
-        BlockGenerator::result_type>
+    std::uint32_t n_sub_blocks() const
     {
-    public:
-        using iterator_category = std::input_iterator_tag;
+        return m_sub_blocks.size();
+    }
 
-        BlockGeneratorIterator(BlockGenerator gen, unsigned index):
-            m_gen(gen), m_index(index)
+    // The block data from its start up to the first original chunk that
+    // hasn't arrived yet (all of it once decoded), so that a consumer can
+    // start on a large block before it is complete. Only grows; may be
+    // called from any thread while symbols are being processed.
+    std::string_view received_prefix() const
+    {
+        if(decoded())
         {
+            return decoded_data();
         }
 
-        auto dereference() const
+        std::uint32_t size = 0;
+        for(std::uint32_t i = 0; i < m_sub_blocks.size(); ++i)
         {
-            return m_gen();
+            auto const& sb = m_sub_blocks[i];
+            std::uint32_t const chunks =
+                m_prefix_chunks[i].load(std::memory_order_acquire);
+            if(chunks < sb.n_original)
+            {
+                size = chunk_extent(sb, chunks).first;
+                break;
+            }
+            size = sb.offset + sb.size;
         }
+        return { m_data.get(), size };
+    }
+
+    // Valid once decoded()
+    std::string_view decoded_data() const
+    {
+        return { m_data.get(), m_block_size };
+    }
+
+    // Original chunk, a slice of the block data
+    std::string_view chunk(SymbolId id) const
+    {
+        auto const& sb = m_sub_blocks.at(id.sub_block);
+        ENFORCE(id.index < sb.n_original);
+
+        auto [offset, size] = chunk_extent(sb, id.index);
+        return { m_data.get() + offset, size };
+    }
 
-        void increment()
+    // Writes symbol id into out, returns the number of bytes written.
+    // Original chunks are copied from the decoded data, the rest is produced
+    // by the sub-block's encoder in place.
+    std::uint32_t write_symbol(SymbolId id, char* out, std::uint32_t out_size)
+    {
+        auto& sb = m_sub_blocks.at(id.sub_block);
+        if(id.index < sb.n_original)
         {
-            ++m_index;
-        }
+            std::string_view data = chunk(id);
+            ENFORCE(data.size() <= out_size);
 
-        bool equal(BlockGeneratorIterator const& other) const
+            std::copy(data.begin(), data.end(), out);
+            return data.size();
+        }
+        else
         {
-            return m_index == other.m_index;
+            ENFORCE(sb.fec.has_value());
+            return sb.fec->encode_symbol(id.index, out, out_size);
         }
+    }
 
-    private:
-        mutable BlockGenerator m_gen;
-        unsigned m_index;
+private:
+    struct SubBlock
+    {
+        std::uint32_t offset;
+        std::uint32_t size;
+        std::uint32_t n_original;
+
+        std::vector<bool> symbols_seen;
+        std::optional<BlockFec> fec;
+        bool decoded = false;
     };
 
-    auto unseen_generator()
+    std::uint32_t m_block_size;
+    BlockCodecId m_codec;
+    BlockSchedule m_schedule;
+    BlockContent m_content = BlockContent::RAW;
+
+    std::shared_ptr<char> m_data;
+    std::shared_ptr<BlockSink> m_sink;  // Receiving side only
+    std::vector<SubBlock> m_sub_blocks;
+    // Per sub-block, original chunks in place from its start on without a
+    // gap. Written on the sub-block's strand, read by received_prefix().
+    std::vector<std::atomic<std::uint32_t>> m_prefix_chunks;
+    std::atomic<std::uint32_t> m_sub_blocks_left;
+
+    // After an original chunk of the sub-block is in place
+    void advance_prefix(std::uint32_t sub_block)
     {
-        return BlockGenerator(*this);
+        auto const& sb = m_sub_blocks[sub_block];
+        auto& prefix = m_prefix_chunks[sub_block];
+        std::uint32_t chunks = prefix.load(std::memory_order_relaxed);
+        while(chunks < sb.n_original && sb.symbols_seen[chunks])
+        {
+            ++chunks;
+        }
+        prefix.store(chunks, std::memory_order_release);
     }
 
-    auto unseen_range(unsigned n)
+    // Offset in the block and size of an original chunk
+    static std::pair<std::uint32_t, std::uint32_t> chunk_extent(
+        SubBlock const& sb, std::uint32_t ix)
     {
-        BlockGenerator g = unseen_generator();
-        return boost::make_iterator_range(
-            BlockGeneratorIterator(g, 0),
-            BlockGeneratorIterator(g, n)
-        );
+        std::uint32_t ix_first = ix * MAX_BLOCK_PACKET_SIZE;
+        std::uint32_t ix_last = std::min(sb.size, (ix + 1) * MAX_BLOCK_PACKET_SIZE);
+        return { sb.offset + ix_first, ix_last - ix_first };
     }
 
-private:
-    std::uint32_t m_block_size;
+    static std::shared_ptr<char const> copy_of(std::string_view data)
+    {
+        auto storage = std::make_shared<std::vector<char>>(
+            data.begin(), data.end());
+        return std::shared_ptr<char const>(storage, storage->data());
+    }
 
-    std::vector<char> m_decoded;
-    std::vector<bool> m_symbols_seen;
+    static std::vector<SubBlock> split(std::uint32_t block_size)
+    {
+        std::uint32_t const n_chunks =
+            (block_size + MAX_BLOCK_PACKET_SIZE - 1) / MAX_BLOCK_PACKET_SIZE;
+        std::uint32_t const n_sub_blocks = std::max(1u,
+            (n_chunks + MAX_SUB_BLOCK_SYMBOLS - 1) / MAX_SUB_BLOCK_SYMBOLS);
+        std::uint32_t const sub_block_chunks =
+            (n_chunks + n_sub_blocks - 1) / n_sub_blocks;
 
-    BlockFec m_fec;
-};
\ No newline at end of file
+        std::vector<SubBlock> result;
+        for(std::uint32_t sb = 0; sb < n_sub_blocks; ++sb)
+        {
+            std::uint32_t offset = sb * sub_block_chunks * MAX_BLOCK_PACKET_SIZE;
+            std::uint32_t size = std::min(block_size - offset,
+                sub_block_chunks * MAX_BLOCK_PACKET_SIZE);
+            SubBlock& sub_block = result.emplace_back();
+            sub_block.offset = offset;
+            sub_block.size = size;
+            sub_block.n_original =
+                (size + MAX_BLOCK_PACKET_SIZE - 1) / MAX_BLOCK_PACKET_SIZE;
+        }
+        return result;
+    }
+};
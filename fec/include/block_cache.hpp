@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "block.hpp"
+#include "utility.hpp"
+
+// Decoded blocks kept around to serve late subscribers, least recently used
+// evicted first once their footprint exceeds the byte budget. The newest
+// block is always kept, even if it alone is over budget.
+// on_evicted lets the owner forget the rest of the block's state.
+class BlockCache
+{
+public:
+    using Key = std::pair<std::uint32_t, std::uint32_t>;  // channel, block
+    using Evicted = std::function<void(Key)>;
+
+    struct Stats
+    {
+        std::uint64_t blocks = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t budget = 0;
+        std::uint64_t evictions = 0;
+
+        friend std::ostream& operator <<(std::ostream& os, Stats const& s)
+        {
+            return os
+                << "blocks=" << s.blocks
+                << " bytes=" << s.bytes
+                << " budget=" << s.budget
+                << " evictions=" << s.evictions;
+        }
+    };
+
+    BlockCache(std::uint64_t byte_budget, Evicted on_evicted):
+        m_on_evicted(std::move(on_evicted))
+    {
+        m_stats.budget = byte_budget;
+    }
+
+    BlockCache(BlockCache const &) = delete;
+
+    void insert(Key key, std::shared_ptr<Block> block)
+    {
+        auto it = m_index.find(key);
+        if(it != m_index.end())
+        {
+            touch(it->second);
+            return;
+        }
+
+        std::uint64_t const bytes = block->footprint();
+        m_entries.push_front({key, std::move(block), bytes});
+        m_index.emplace(key, m_entries.begin());
+        ++m_stats.blocks;
+        m_stats.bytes += bytes;
+
+        while(m_stats.bytes > m_stats.budget && m_entries.size() > 1)
+        {
+            evict_last();
+        }
+    }
+
+    // Marks the block as recently used, nullptr if not cached
+    std::shared_ptr<Block> find(Key key)
+    {
+        auto it = m_index.find(key);
+        if(it == m_index.end())
+        {
+            return nullptr;
+        }
+        touch(it->second);
+        return it->second->block;
+    }
+
+    // Removes the block without calling on_evicted, e.g. once it has expired
+    void erase(Key key)
+    {
+        auto it = m_index.find(key);
+        if(it == m_index.end())
+        {
+            return;
+        }
+        m_stats.bytes -= it->second->bytes;
+        --m_stats.blocks;
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    // Calls f(block_id, block) for the channel's blocks, oldest first
+    template <class F>
+    void for_each(std::uint32_t channel_id, F&& f) const
+    {
+        for(auto it = m_entries.rbegin(); it != m_entries.rend(); ++it)
+        {
+            if(it->key.first == channel_id)
+            {
+                f(it->key.second, it->block);
+            }
+        }
+    }
+
+    Stats const& stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<Block> block;
+        std::uint64_t bytes;
+    };
+    using Entries = std::list<Entry>;  // Most recently used first
+
+    Evicted m_on_evicted;
+    Entries m_entries;
+    std::unordered_map<Key, Entries::iterator, boost::hash<Key>> m_index;
+    Stats m_stats;
+
+    void touch(Entries::iterator it)
+    {
+        m_entries.splice(m_entries.begin(), m_entries, it);
+    }
+
+    void evict_last()
+    {
+        Entry& last = m_entries.back();
+        Key const key = last.key;
+        m_stats.bytes -= last.bytes;
+        --m_stats.blocks;
+        ++m_stats.evictions;
+
+        m_index.erase(key);
+        m_entries.pop_back();
+        m_on_evicted(key);
+    }
+};
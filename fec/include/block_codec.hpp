@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+// Sent in the block packet header
+enum class BlockCodecId: std::uint32_t
+{
+    WIREHAIR,
+    CAUCHY,
+};
+
+inline std::ostream& operator <<(std::ostream& os, BlockCodecId codec)
+{
+    return os << (codec == BlockCodecId::CAUCHY ? "cauchy" : "wirehair");
+}
+
+// A block erasure code behind BlockFec, see the BlockFec workflow.
+// Encoders are constructed over the block, decoders with its size only.
+class BlockCodec
+{
+public:
+    virtual ~BlockCodec() = default;
+
+    // Returns the number of bytes written
+    virtual std::uint32_t encode_symbol(unsigned symbol_index, char* out,
+        std::uint32_t out_size) = 0;
+
+    // Returns true once the block can be recovered
+    virtual bool process_symbol(std::string_view data, unsigned symbol_index) = 0;
+
+    virtual void recover(char* out) = 0;
+
+    // Returns the size of the chunk
+    virtual std::uint32_t recover_chunk(unsigned chunk_index, char* out) = 0;
+
+    virtual void become_encoder() = 0;
+};
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <string_view>
+#include <vector>
+
+#include <gf256.h>
+
+#include "block_codec.hpp"
+#include "utility.hpp"
+
+// Scalar GF(256) arithmetic, tabulated with the library's bulk multiply.
+// The inline gf256_mul() and gf256_inv() read GF256Ctx, whose layout depends
+// on whether the including file is compiled with AVX2, so they can't be used
+// from code built with other flags than the library.
+class Gf256Scalar
+{
+public:
+    static Gf256Scalar const& instance()
+    {
+        static Gf256Scalar tables;
+        return tables;
+    }
+
+    std::uint8_t mul(std::uint8_t x, std::uint8_t y) const
+    {
+        return m_mul[y * 256 + x];
+    }
+
+    std::uint8_t inv(std::uint8_t x) const
+    {
+        return m_inv[x];
+    }
+
+private:
+    std::vector<std::uint8_t> m_mul;
+    std::array<std::uint8_t, 256> m_inv = {};
+
+    Gf256Scalar(): m_mul(256 * 256)
+    {
+        std::array<std::uint8_t, 256> x;
+        std::iota(x.begin(), x.end(), 0);
+        for(unsigned y = 0; y < 256; ++y)
+        {
+            gf256_mul_mem(&m_mul[y * 256], x.data(), y, 256);
+        }
+        for(unsigned a = 1; a < 256; ++a)
+        {
+            for(unsigned b = 1; b < 256; ++b)
+            {
+                if(mul(a, b) == 1)
+                {
+                    m_inv[a] = b;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+// Systematic Cauchy Reed-Solomon code over GF(256), in the style of cm256.
+// There's no setup to speak of and any N distinct symbols recover the block,
+// but encoding a symbol costs N multiply-adds, so it is for small N only.
+//
+// Recovery symbol index >= N is the row 1 / (x + y_j) of the Cauchy matrix,
+// with x = index and y_j = j. There are only 256 - N such rows, so there
+// are no symbols from index MAX_SYMBOLS on.
+class CauchyBlockCodec: public BlockCodec
+{
+public:
+    static std::uint32_t const MAX_N = 128;
+    static std::uint32_t const MAX_SYMBOLS = 256;
+
+    // Encoder, references block without copying it
+    CauchyBlockCodec(std::string_view block, std::uint32_t symbol_size):
+        CauchyBlockCodec(block.size(), symbol_size, true)
+    {
+        m_data = block.data();
+    }
+
+    // Decoder
+    CauchyBlockCodec(std::uint64_t block_size, std::uint32_t symbol_size):
+        CauchyBlockCodec(block_size, symbol_size, false)
+    {
+        m_recovered.resize(std::size_t(m_n) * m_symbol_size);
+        m_seen.resize(m_n);
+    }
+
+    static bool supports(std::uint64_t n_symbols)
+    {
+        return n_symbols >= 1 && n_symbols <= MAX_N;
+    }
+
+    std::uint32_t encode_symbol(unsigned symbol_index, char* out,
+        std::uint32_t out_size) override
+    {
+        ENFORCE(m_data);
+        if(symbol_index < m_n)
+        {
+            std::uint32_t const size = chunk_size(symbol_index);
+            ENFORCE(size <= out_size);
+            std::copy_n(chunk(symbol_index), size, out);
+            return size;
+        }
+
+        ENFORCE(symbol_index < MAX_SYMBOLS && m_symbol_size <= out_size);
+        std::uint8_t const x = symbol_index;
+        std::fill_n(out, m_symbol_size, 0);
+        for(std::uint32_t j = 0; j < m_n; ++j)
+        {
+            gf256_muladd_mem(out, coefficient(x, j), chunk(j), chunk_size(j));
+        }
+        return m_symbol_size;
+    }
+
+    bool process_symbol(std::string_view data, unsigned symbol_index) override
+    {
+        if(m_decoded)
+        {
+            return true;
+        }
+        ENFORCE(data.size() <= m_symbol_size && symbol_index < MAX_SYMBOLS);
+
+        if(symbol_index < m_n)
+        {
+            if(!m_seen[symbol_index])
+            {
+                m_seen[symbol_index] = true;
+                ++m_n_seen;
+                std::copy(data.begin(), data.end(),
+                    &m_recovered[std::size_t(symbol_index) * m_symbol_size]);
+            }
+        }
+        else
+        {
+            std::uint8_t const x = symbol_index;
+            bool const is_new = std::none_of(m_rows.begin(), m_rows.end(),
+                [x](Row const& row) { return row.x == x; });
+            if(is_new)
+            {
+                Row& row = m_rows.emplace_back();
+                row.x = x;
+                row.data.assign(m_symbol_size, 0);
+                std::copy(data.begin(), data.end(), row.data.begin());
+            }
+        }
+
+        if(m_n_seen + m_rows.size() < m_n)
+        {
+            return false;
+        }
+
+        solve();
+        return true;
+    }
+
+    void recover(char* out) override
+    {
+        ENFORCE(m_decoded);
+        std::copy_n(m_recovered.data(), m_block_size, out);
+    }
+
+    std::uint32_t recover_chunk(unsigned chunk_index, char* out) override
+    {
+        ENFORCE(m_decoded && chunk_index < m_n);
+        std::uint32_t const size = chunk_size(chunk_index);
+        std::copy_n(chunk(chunk_index), size, out);
+        return size;
+    }
+
+    void become_encoder() override
+    {
+        ENFORCE(m_decoded);
+    }
+
+private:
+    struct Row
+    {
+        std::uint8_t x;
+        std::vector<char> data;
+    };
+
+    std::uint64_t m_block_size;
+    std::uint32_t m_symbol_size;
+    std::uint32_t m_n;
+
+    char const* m_data = nullptr;   // Original chunks, back to back
+    bool m_decoded;
+
+    // Decoder: originals in place (zero padded), recovery rows on the side
+    std::vector<char> m_recovered;
+    std::vector<bool> m_seen;
+    std::uint32_t m_n_seen = 0;
+    std::vector<Row> m_rows;
+
+    CauchyBlockCodec(std::uint64_t block_size, std::uint32_t symbol_size,
+        bool decoded):
+        m_block_size(block_size),
+        m_symbol_size(symbol_size),
+        m_n((block_size + symbol_size - 1) / symbol_size),
+        m_decoded(decoded)
+    {
+        ENFORCE(supports(m_n));
+    }
+
+    static std::uint8_t coefficient(std::uint8_t x, std::uint32_t j)
+    {
+        return Gf256Scalar::instance().inv(x ^ std::uint8_t(j));
+    }
+
+    char const* chunk(std::uint32_t j) const
+    {
+        return m_data + std::size_t(j) * m_symbol_size;
+    }
+
+    std::uint32_t chunk_size(std::uint32_t j) const
+    {
+        return std::min<std::uint64_t>(m_symbol_size,
+            m_block_size - std::uint64_t(j) * m_symbol_size);
+    }
+
+    // Gauss-Jordan on the square Cauchy submatrix of the missing chunks,
+    // which is always invertible
+    void solve()
+    {
+        std::vector<std::uint32_t> missing;
+        for(std::uint32_t j = 0; j < m_n; ++j)
+        {
+            if(!m_seen[j])
+            {
+                missing.push_back(j);
+            }
+        }
+        std::size_t const e = missing.size();
+        m_rows.resize(e);
+
+        // Take the chunks we have out of the recovery symbols
+        char* const recovered = m_recovered.data();
+        for(auto& row : m_rows)
+        {
+            for(std::uint32_t j = 0; j < m_n; ++j)
+            {
+                if(m_seen[j])
+                {
+                    gf256_muladd_mem(row.data.data(), coefficient(row.x, j),
+                        recovered + std::size_t(j) * m_symbol_size,
+                        m_symbol_size);
+                }
+            }
+        }
+
+        std::vector<std::uint8_t> a(e * e);
+        for(std::size_t r = 0; r < e; ++r)
+        {
+            for(std::size_t c = 0; c < e; ++c)
+            {
+                a[r * e + c] = coefficient(m_rows[r].x, missing[c]);
+            }
+        }
+
+        for(std::size_t c = 0; c < e; ++c)
+        {
+            std::size_t pivot = c;
+            while(a[pivot * e + c] == 0)
+            {
+                ++pivot;
+                ENFORCE(pivot < e);
+            }
+            if(pivot != c)
+            {
+                std::swap_ranges(&a[pivot * e], &a[pivot * e] + e, &a[c * e]);
+                std::swap(m_rows[pivot].data, m_rows[c].data);
+            }
+
+            auto const& gf = Gf256Scalar::instance();
+            std::uint8_t const inv = gf.inv(a[c * e + c]);
+            for(std::size_t k = 0; k < e; ++k)
+            {
+                a[c * e + k] = gf.mul(a[c * e + k], inv);
+            }
+            gf256_mul_mem(m_rows[c].data.data(), m_rows[c].data.data(), inv,
+                m_symbol_size);
+
+            for(std::size_t r = 0; r < e; ++r)
+            {
+                std::uint8_t const f = a[r * e + c];
+                if(r == c || f == 0)
+                {
+                    continue;
+                }
+                for(std::size_t k = 0; k < e; ++k)
+                {
+                    a[r * e + k] ^= gf.mul(a[c * e + k], f);
+                }
+                gf256_muladd_mem(m_rows[r].data.data(), f,
+                    m_rows[c].data.data(), m_symbol_size);
+            }
+        }
+
+        for(std::size_t c = 0; c < e; ++c)
+        {
+            std::copy(m_rows[c].data.begin(), m_rows[c].data.end(),
+                recovered + std::size_t(missing[c]) * m_symbol_size);
+        }
+
+        m_rows.clear();
+        m_rows.shrink_to_fit();
+        m_data = recovered;
+        m_decoded = true;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include <boost/asio.hpp>
+
+#include "block.hpp"
+#include "packet.hpp"
+#include "utility.hpp"
+
+// Feeds received block symbols to their decoders on a thread pool.
+// Symbols of one sub-block are serialized on that sub-block's strand,
+// different blocks and sub-blocks decode in parallel.
+// on_decoded is called on the io_context thread.
+// With zero threads, symbols are decoded inline on the calling thread.
+class BlockDecoderService
+{
+public:
+    using Callback = std::function<void()>;
+    using Strand = std::optional<
+        boost::asio::strand<boost::asio::thread_pool::executor_type>>;
+
+    BlockDecoderService(boost::asio::io_context& io_context, unsigned n_threads):
+        m_io_context(io_context)
+    {
+        if(n_threads > 0)
+        {
+            m_pool.emplace(n_threads);
+        }
+    }
+
+    BlockDecoderService(BlockDecoderService const &) = delete;
+
+    ~BlockDecoderService()
+    {
+        if(m_pool)
+        {
+            m_pool->join();
+        }
+    }
+
+    // One per sub-block
+    Strand make_strand()
+    {
+        if(!m_pool)
+        {
+            return {};
+        }
+        return boost::asio::make_strand(m_pool->get_executor());
+    }
+
+    void decode(Strand& strand, std::shared_ptr<Block> block, Packet packet,
+        Callback on_decoded)
+    {
+        if(!strand)
+        {
+            if(process(*block, packet))
+            {
+                on_decoded();
+            }
+            return;
+        }
+
+        boost::asio::post(*strand, [this, block, packet, on_decoded]() {
+            if(process(*block, packet))
+            {
+                boost::asio::post(m_io_context, on_decoded);
+            }
+        });
+    }
+
+private:
+    boost::asio::io_context& m_io_context;
+    std::optional<boost::asio::thread_pool> m_pool;
+
+    static bool process(Block& block, Packet const& packet)
+    {
+        auto const& h = packet.header<BlockPacketHeader>();
+        return block.process_symbol(
+            packet.payload<BlockPacketHeader>(),
+            {h.m_sub_block, h.m_packet_index}
+        );
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <boost/asio.hpp>
+
+#include "block.hpp"
+#include "fec.hpp"
+#include "utility.hpp"
+
+// Solves block encoders on a thread pool, one job per sub-block.
+// The caller sends original chunks while the solve runs (they don't need the
+// encoder); the encoder is installed into the block on the io_context thread,
+// and on_ready is called there, when FEC symbols can be generated.
+class BlockEncoderService
+{
+public:
+    using Callback = std::function<void(Block&)>;
+
+    BlockEncoderService(boost::asio::io_context& io_context,
+        unsigned n_threads = std::thread::hardware_concurrency()):
+        m_io_context(io_context),
+        m_pool(std::max(n_threads, 1u))
+    {
+    }
+
+    BlockEncoderService(BlockEncoderService const &) = delete;
+
+    ~BlockEncoderService()
+    {
+        m_pool.join();
+    }
+
+    // Solves the sub-blocks in parallel, on_ready is called once all are done
+    void encode(std::shared_ptr<Block> block, Callback on_ready)
+    {
+        // Only touched on the io_context thread
+        auto left = std::make_shared<std::uint32_t>(block->n_sub_blocks());
+
+        for(std::uint32_t sb = 0; sb < block->n_sub_blocks(); ++sb)
+        {
+            // Keep io_context.run() going until the result has been posted back
+            auto work = boost::asio::make_work_guard(m_io_context);
+
+            boost::asio::post(m_pool, [this, block, sb, left, on_ready, work]() {
+                auto t0 = Clock::now();
+                auto fec = std::make_shared<BlockFec>(block->make_encoder(sb));
+                auto elapsed = Clock::now() - t0;
+
+                boost::asio::post(m_io_context,
+                    [block, sb, left, on_ready, fec, elapsed]() {
+                        std::cout << "Encoder ready: bs=" << block->block_size()
+                            << " sb=" << sb
+                            << " solve_us=" << std::chrono::duration_cast<
+                                std::chrono::microseconds>(elapsed).count()
+                            << std::endl;
+                        block->set_encoder(sb, std::move(*fec));
+                        if(--*left == 0)
+                        {
+                            on_ready(*block);
+                        }
+                    });
+            });
+        }
+    }
+
+private:
+    boost::asio::io_context& m_io_context;
+    boost::asio::thread_pool m_pool;
+};
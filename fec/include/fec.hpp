@@ -1,7 +1,9 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string_view>
 #include <type_traits>
 #include <vector>
@@ -9,6 +11,8 @@
 #include <wirehair.h>
 #include <siamese.h>
 
+#include "block_codec.hpp"
+#include "cauchy.hpp"
 #include "utility.hpp"
 
 
@@ -18,6 +22,135 @@ using PtrWithDeleteFunction = std::unique_ptr<
     void(*)(CPtr)
 >;
 
+// Recycles wirehair codec objects between blocks.
+// wirehair_*_create() keep the buffers of the codec passed in as reuseOpt when
+// they are large enough, so codecs are pooled by symbol-count class (the next
+// power of two) to make that likely. Thread-safe.
+class WirehairCodecPool
+{
+public:
+    static std::size_t const MAX_CODECS_PER_CLASS = 4;
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t pooled = 0;
+
+        friend std::ostream& operator <<(std::ostream& os, Stats const& s)
+        {
+            return os
+                << "hits=" << s.hits
+                << " misses=" << s.misses
+                << " pooled=" << s.pooled;
+        }
+    };
+
+    // Returns a codec to the pool it came from
+    class Releaser
+    {
+    public:
+        explicit Releaser(unsigned size_class): m_size_class(size_class)
+        {
+        }
+
+        void operator()(WirehairCodec codec) const
+        {
+            instance().release(m_size_class, codec);
+        }
+
+    private:
+        unsigned m_size_class;
+    };
+
+    using Ptr = std::unique_ptr<std::remove_pointer_t<WirehairCodec>, Releaser>;
+
+    static WirehairCodecPool& instance()
+    {
+        static WirehairCodecPool pool;
+        return pool;
+    }
+
+    WirehairCodecPool() = default;
+    WirehairCodecPool(WirehairCodecPool const &) = delete;
+
+    ~WirehairCodecPool()
+    {
+        for(auto& codecs : m_codecs)
+        {
+            for(WirehairCodec codec : codecs)
+            {
+                wirehair_free(codec);
+            }
+        }
+    }
+
+    static unsigned size_class(std::uint64_t n_symbols)
+    {
+        unsigned c = 0;
+        while(c < N_CLASSES - 1 && (std::uint64_t(1) << c) < n_symbols)
+        {
+            ++c;
+        }
+        return c;
+    }
+
+    // Returns a codec to pass as reuseOpt, or nullptr if there is none
+    WirehairCodec acquire(unsigned size_class)
+    {
+        std::lock_guard lock(m_mutex);
+        auto& codecs = m_codecs[size_class];
+        if(codecs.empty())
+        {
+            ++m_stats.misses;
+            return nullptr;
+        }
+
+        ++m_stats.hits;
+        --m_stats.pooled;
+        WirehairCodec codec = codecs.back();
+        codecs.pop_back();
+        return codec;
+    }
+
+    void release(unsigned size_class, WirehairCodec codec)
+    {
+        std::unique_lock lock(m_mutex);
+        auto& codecs = m_codecs[size_class];
+        if(codecs.size() >= MAX_CODECS_PER_CLASS)
+        {
+            lock.unlock();
+            wirehair_free(codec);
+            return;
+        }
+
+        ++m_stats.pooled;
+        codecs.push_back(codec);
+    }
+
+    // Creates a codec with create(reuse_opt), reusing a pooled one if any
+    template <class Create>
+    Ptr make(std::uint64_t n_symbols, Create&& create)
+    {
+        unsigned c = size_class(n_symbols);
+        // On failure wirehair frees the codec that was passed for reuse
+        return Ptr(create(acquire(c)), Releaser(c));
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    static unsigned const N_CLASSES = 17;  // wirehair allows up to 64000
+
+    mutable std::mutex m_mutex;
+    std::array<std::vector<WirehairCodec>, N_CLASSES> m_codecs;
+    Stats m_stats;
+};
+
 // === Terminology ===
 //
 // We start out with:
@@ -40,60 +173,72 @@ using PtrWithDeleteFunction = std::unique_ptr<
 // The same class works as both encoder and decoder.
 // On the sending side:
 // - Construct with the entire block.
-// - Call get_symbol_data to obtain FEC symbols.
+// - Call encode_symbol (or get_symbol_data) to obtain FEC symbols.
 //
 // On the receiving side:
 // - Construct with size option only.
-// - Feed symbols to process_symbol() until nonempty result returned
-//   (which is the recovered block).
-// - Call get_symbol_data to obtain original data and FEC symbols.
-class BlockFec
+// - Feed symbols to process_symbol() until it returns true.
+// - Call recover() or recover_chunk() to obtain the original data.
+// - Call become_encoder(), then encode_symbol to obtain FEC symbols.
+//
+// Both sides must use the same codec, BlockFec::choose_codec() picks one by
+// block size.
+
+class WirehairBlockCodec: public BlockCodec
 {
 public:
-    BlockFec(std::string_view block):
-        m_wirehair(
-            wirehair_encoder_create(
-                nullptr,
-                char_cast<void const *>(block.data()),
-                block.size(),
-                MAX_BLOCK_PACKET_SIZE
-            ),
-            wirehair_free
-        )
+    WirehairBlockCodec(std::string_view block, std::uint32_t symbol_size):
+        m_wirehair(WirehairCodecPool::instance().make(
+            n_symbols(block.size(), symbol_size),
+            [&](WirehairCodec reuse) {
+                return wirehair_encoder_create(
+                    reuse,
+                    char_cast<void const *>(block.data()),
+                    block.size(),
+                    symbol_size
+                );
+            }
+        ))
     {
         ENFORCE(m_wirehair.get());
     }
 
-    BlockFec(std::uint64_t block_size):
+    WirehairBlockCodec(std::uint64_t block_size, std::uint32_t symbol_size):
         m_block_size(block_size),
-        m_wirehair(
-            wirehair_decoder_create(
-                nullptr,
-                block_size,
-                MAX_BLOCK_PACKET_SIZE
-            ),
-            wirehair_free
-        )
+        m_wirehair(WirehairCodecPool::instance().make(
+            n_symbols(block_size, symbol_size),
+            [&](WirehairCodec reuse) {
+                return wirehair_decoder_create(
+                    reuse,
+                    block_size,
+                    symbol_size
+                );
+            }
+        ))
     {
         ENFORCE(m_wirehair.get());
     }
 
-    Bytes get_symbol_data(unsigned symbol_index)
+    static bool supports(std::uint64_t n_symbols)
+    {
+        return n_symbols >= 2 && n_symbols <= 64000;
+    }
+
+    std::uint32_t encode_symbol(unsigned symbol_index, char* out,
+        std::uint32_t out_size) override
     {
-        Bytes res(MAX_BLOCK_PACKET_SIZE);
         std::uint32_t bytes_written;
         ENFORCE(wirehair_encode(
             m_wirehair.get(),
             symbol_index,
-            &res[0],
-            res.size(),
+            out,
+            out_size,
             &bytes_written
         ) == 0);
-        res.resize(bytes_written);
-        return res;
+        return bytes_written;
     }
 
-    std::vector<char> process_symbol(std::string_view data, unsigned symbol_index)
+    bool process_symbol(std::string_view data, unsigned symbol_index) override
     {
         WirehairResult res = wirehair_decode(
             m_wirehair.get(),
@@ -104,27 +249,184 @@ public:
 
         if(res == Wirehair_NeedMore)
         {
-            return {};
+            return false;
         }
 
         if(res == Wirehair_Success)
         {
-            std::vector<char> res(m_block_size);
-            ENFORCE(wirehair_recover(
-                m_wirehair.get(),
-                &res[0],
-                res.size()
-            ) == 0);
-            ENFORCE(wirehair_decoder_becomes_encoder(m_wirehair.get()) == 0);
-            return res;
+            return true;
         }
 
         throw std::runtime_error(wirehair_result_string(res));
     }
 
+    void recover(char* out) override
+    {
+        ENFORCE(wirehair_recover(
+            m_wirehair.get(),
+            out,
+            m_block_size
+        ) == 0);
+    }
+
+    std::uint32_t recover_chunk(unsigned chunk_index, char* out) override
+    {
+        std::uint32_t bytes_written;
+        ENFORCE(wirehair_recover_block(
+            m_wirehair.get(),
+            chunk_index,
+            out,
+            &bytes_written
+        ) == 0);
+        return bytes_written;
+    }
+
+    void become_encoder() override
+    {
+        ENFORCE(wirehair_decoder_becomes_encoder(m_wirehair.get()) == 0);
+    }
+
 private:
     std::uint32_t m_block_size;
-    PtrWithDeleteFunction<WirehairCodec> m_wirehair;
+    WirehairCodecPool::Ptr m_wirehair;
+
+    static std::uint64_t n_symbols(std::uint64_t block_size,
+        std::uint32_t symbol_size)
+    {
+        return (block_size + symbol_size - 1) / symbol_size;
+    }
+};
+
+class BlockFec
+{
+public:
+    // Up to this many symbols Cauchy Reed-Solomon is cheaper than wirehair
+    // for a relay (decode, then encode N * REDUNDANCY), see codec_bench.
+    // It stays so up to about 128, but only 20% cheaper past 64, and there
+    // N * MAX_REDUNDANCY would run out of Cauchy symbols on a lossy link.
+    static std::uint64_t const MAX_CAUCHY_SYMBOLS = 64;
+
+    static BlockCodecId choose_codec(std::uint64_t block_size)
+    {
+        return n_symbols(block_size) <= MAX_CAUCHY_SYMBOLS ?
+            BlockCodecId::CAUCHY : BlockCodecId::WIREHAIR;
+    }
+
+    // Whether codec can code a block of this size
+    static bool supports(BlockCodecId codec, std::uint64_t block_size)
+    {
+        switch(codec)
+        {
+        case BlockCodecId::WIREHAIR:
+            return WirehairBlockCodec::supports(n_symbols(block_size));
+        case BlockCodecId::CAUCHY:
+            return CauchyBlockCodec::supports(n_symbols(block_size));
+        }
+        return false;
+    }
+
+    // Symbol indices of a (sub-)block of n_original chunks are below this.
+    // Wirehair has no limit of its own, but no sender goes past
+    // MAX_REDUNDANCY times the chunks in each of MAX_PARTITION_SLOTS slots,
+    // so a higher index off the wire is bogus.
+    static std::uint32_t max_symbols(BlockCodecId codec,
+        std::uint32_t n_original)
+    {
+        if(codec == BlockCodecId::CAUCHY)
+        {
+            return CauchyBlockCodec::MAX_SYMBOLS;
+        }
+        return std::uint32_t(n_original * MAX_REDUNDANCY + 1) *
+            MAX_PARTITION_SLOTS;
+    }
+
+    BlockFec(std::string_view block, BlockCodecId codec):
+        m_codec_id(codec),
+        m_codec(make<std::string_view>(codec, block))
+    {
+    }
+
+    BlockFec(std::uint64_t block_size, BlockCodecId codec):
+        m_codec_id(codec),
+        m_codec(make<std::uint64_t>(codec, block_size))
+    {
+    }
+
+    static std::uint64_t n_symbols(std::uint64_t block_size)
+    {
+        return (block_size + MAX_BLOCK_PACKET_SIZE - 1) / MAX_BLOCK_PACKET_SIZE;
+    }
+
+    BlockCodecId codec() const
+    {
+        return m_codec_id;
+    }
+
+    // Writes the symbol directly into `out` (typically the payload area of
+    // a packet buffer), returns the number of bytes written.
+    std::uint32_t encode_symbol(unsigned symbol_index, char* out,
+        std::uint32_t out_size)
+    {
+        return m_codec->encode_symbol(symbol_index, out, out_size);
+    }
+
+    Bytes get_symbol_data(unsigned symbol_index)
+    {
+        Bytes res(MAX_BLOCK_PACKET_SIZE);
+        res.resize(encode_symbol(symbol_index, &res[0], res.size()));
+        return res;
+    }
+
+    // Returns true once enough symbols have been received to recover
+    // the block
+    bool process_symbol(std::string_view data, unsigned symbol_index)
+    {
+        return m_codec->process_symbol(data, symbol_index);
+    }
+
+    // Recovers the whole block into out (block size bytes)
+    void recover(char* out)
+    {
+        m_codec->recover(out);
+    }
+
+    // Recovers a single original chunk into out, returns its size.
+    // Cheaper than recover() when most chunks are already in place.
+    std::uint32_t recover_chunk(unsigned chunk_index, char* out)
+    {
+        return m_codec->recover_chunk(chunk_index, out);
+    }
+
+    // After recovery: lets the decoder produce FEC symbols
+    void become_encoder()
+    {
+        m_codec->become_encoder();
+    }
+
+private:
+    BlockCodecId m_codec_id;
+    std::unique_ptr<BlockCodec> m_codec;
+
+    template <class Arg>
+    static std::unique_ptr<BlockCodec> make(BlockCodecId codec, Arg arg)
+    {
+        ENFORCE(supports(codec, arg_size(arg)));
+        if(codec == BlockCodecId::CAUCHY)
+        {
+            return std::make_unique<CauchyBlockCodec>(arg, MAX_BLOCK_PACKET_SIZE);
+        }
+        return std::make_unique<WirehairBlockCodec>(arg, MAX_BLOCK_PACKET_SIZE);
+    }
+
+    static std::uint64_t arg_size(std::string_view block)
+    {
+        return block.size();
+    }
+
+    static std::uint64_t arg_size(std::uint64_t block_size)
+    {
+        return block_size;
+    }
 };
 
 class StreamFecCommon
@@ -309,8 +611,12 @@ private:
     PtrWithDeleteFunction<SiameseDecoder> m_decoder;
 };
 
-inline void fec_init()
+// stripe_threads: threads for each wirehair solve, each taking a stripe of
+// the symbol bytes. On top of the encoder and decoder threads, which work on
+// different sub-blocks.
+inline void fec_init(unsigned stripe_threads = 1)
 {
     wirehair_init();
+    wirehair_set_stripe_threads(stripe_threads);
     siamese_init();
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <optional>
 #include <boost/circular_buffer.hpp>
 
 #include "utility.hpp"
@@ -52,6 +58,87 @@ private:
     }
 };
 
+// Both directions of the link to a peer. Every packet sent carries a
+// sequence number, the peer reports every so often how many it got
+// (like RTCP receiver reports), which gives the loss rate of the link.
+class LinkMonitor
+{
+public:
+    static std::uint32_t const REPORT_EVERY = 32;     // Packets received
+    static std::uint32_t const MIN_REPORT_SPAN = 16;  // Packets sent
+    static constexpr float LOSS_WEIGHT = 0.25;        // Of a new sample
+
+    // Sending side
+
+    std::uint32_t next_seq()
+    {
+        return ++m_seq;
+    }
+
+    void process_report(std::uint32_t received, std::uint32_t highest_seq)
+    {
+        std::uint32_t const span = highest_seq - m_report_highest_seq;
+        if(highest_seq > m_seq || span < MIN_REPORT_SPAN)
+        {
+            return;
+        }
+
+        std::uint32_t const got = std::min(span, received - m_report_received);
+        float const sample = 1 - float(got) / span;
+        m_loss += LOSS_WEIGHT * (sample - m_loss);
+
+        m_report_received = received;
+        m_report_highest_seq = highest_seq;
+    }
+
+    float loss() const
+    {
+        return m_loss;
+    }
+
+    // Symbols to send per original chunk so that enough get through
+    float redundancy() const
+    {
+        return std::min(MAX_REDUNDANCY,
+            (1 + REDUNDANCY_MARGIN) / std::max(0.01f, 1 - m_loss));
+    }
+
+    // Receiving side, returns true when a report is due
+
+    bool did_receive(std::uint32_t seq)
+    {
+        m_highest_received_seq = std::max(m_highest_received_seq, seq);
+        return ++m_received % REPORT_EVERY == 0;
+    }
+
+    std::uint32_t received() const
+    {
+        return m_received;
+    }
+
+    std::uint32_t highest_received_seq() const
+    {
+        return m_highest_received_seq;
+    }
+
+private:
+    std::uint32_t m_seq = 0;
+    std::uint32_t m_report_received = 0;
+    std::uint32_t m_report_highest_seq = 0;
+    // Until the reports say otherwise, what REDUNDANCY makes up for
+    float m_loss = 1 - (1 + REDUNDANCY_MARGIN) / REDUNDANCY;
+
+    std::uint32_t m_received = 0;
+    std::uint32_t m_highest_received_seq = 0;
+};
+
+// Produces packets on demand, std::nullopt once it has no more
+using PacketSource = std::function<std::optional<Bytes>()>;
+
+// Queued packets and packets pulled from the sources go out by priority,
+// higher first, only when the shaper allows a send. Queued packets go before
+// sources of the same priority and in the order they were pushed; sources of
+// the same priority take turns, one packet at a time.
 class ShapedPacketQueue
 {
 public:
@@ -61,33 +148,114 @@ public:
     }
 
     bool empty() const {
-        return m_packets.empty();
+        return m_packets.empty() && m_sources.empty();
     }
 
-    void push(Bytes packet)
+    void push(Bytes packet, std::uint64_t priority = 0)
     {
-        m_packets.push(std::move(packet));
+        m_packets.push({priority, m_n_pushed++, std::move(packet)});
     }
 
-    time_point_t when_can_pop() const
+    // Sources can be dropped by tag, see drop()
+    void add_source(PacketSource source, std::uint64_t tag = 0,
+        std::uint64_t priority = 0)
+    {
+        m_sources[priority].push_back({std::move(source), tag});
+    }
+
+    // Drops the queued packets matching pred and the sources tagged tag
+    template <class Pred>
+    void drop(Pred pred, std::uint64_t tag)
     {
-        if(m_packets.empty())
+        m_packets.remove_if([&](QueuedPacket const& q) {
+            return pred(q.packet);
+        });
+        for(auto it = m_sources.begin(); it != m_sources.end(); )
         {
-            return FAR_FUTURE;
+            auto& sources = it->second;
+            sources.erase(std::remove_if(sources.begin(), sources.end(),
+                [tag](auto const& s) { return s.tag == tag; }), sources.end());
+            it = sources.empty() ? m_sources.erase(it) : std::next(it);
         }
+    }
 
-        return m_shaper.when_can_send(m_packets.top().size());
+    time_point_t when_can_pop() const
+    {
+        if(packet_goes_first())
+        {
+            return m_shaper.when_can_send(m_packets.top().packet.size());
+        }
+        if(!m_sources.empty())
+        {
+            // The size is only known once the packet has been generated
+            return m_shaper.when_can_send(MAX_PACKET_SIZE);
+        }
+        return FAR_FUTURE;
     }
 
-    Bytes pop_value(time_point_t now)
+    // std::nullopt if the sources turned out to be exhausted
+    std::optional<Bytes> pop_value(time_point_t now)
     {
-        Bytes packet = m_packets.pop_value();
-        m_shaper.did_send(now, packet.size());
+        std::optional<Bytes> packet;
+        while(!packet && !empty())
+        {
+            if(packet_goes_first())
+            {
+                packet = m_packets.pop_value().packet;
+                break;
+            }
+
+            auto it = m_sources.begin();
+            auto& sources = it->second;
+            TaggedSource source = std::move(sources.front());
+            sources.pop_front();
+            if((packet = source.source()))
+            {
+                sources.push_back(std::move(source));
+            }
+            else if(sources.empty())
+            {
+                m_sources.erase(it);
+            }
+        }
+
+        if(packet)
+        {
+            m_shaper.did_send(now, packet->size());
+        }
         return packet;
     }
 
 private:
+    struct QueuedPacket
+    {
+        std::uint64_t priority;
+        std::uint64_t order;
+        Bytes packet;
+
+        friend bool operator <(QueuedPacket const& x, QueuedPacket const& y)
+        {
+            return x.priority != y.priority ?
+                x.priority < y.priority : x.order > y.order;
+        }
+    };
+
+    struct TaggedSource
+    {
+        PacketSource source;
+        std::uint64_t tag;
+    };
+
     BandwidthShaper m_shaper;
 
-    movable_priority_queue<Bytes> m_packets;
+    movable_priority_queue<QueuedPacket> m_packets;
+    std::uint64_t m_n_pushed = 0;
+    std::map<std::uint64_t, std::deque<TaggedSource>,
+        std::greater<std::uint64_t>> m_sources;  // By priority
+
+    bool packet_goes_first() const
+    {
+        return !m_packets.empty() && (m_sources.empty() ||
+            m_packets.top().priority >= m_sources.begin()->first);
+    }
 };
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utility.hpp"
+
+// A whole file mapped into memory
+class MappedFile
+{
+public:
+    // Maps an existing file, read-only
+    explicit MappedFile(std::string const& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat st;
+        if(::fstat(fd, &st) != 0)
+        {
+            int e = errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), "fstat " + path);
+        }
+        m_size = st.st_size;
+        ENFORCE(m_size > 0);
+
+        map(fd, PROT_READ, MAP_PRIVATE, path);
+
+        // Chunks are read front to back, by the encoder and by the sender
+        ::madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+
+    // Creates (or truncates) a file of the given size, mapped read-write
+    MappedFile(std::string const& path, std::uint64_t size):
+        m_size(size),
+        m_writable(true)
+    {
+        ENFORCE(m_size > 0);
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        if(::ftruncate(fd, m_size) != 0)
+        {
+            int e = errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), "ftruncate " + path);
+        }
+
+        map(fd, PROT_READ | PROT_WRITE, MAP_SHARED, path);
+    }
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile& operator =(MappedFile const &) = delete;
+
+    ~MappedFile()
+    {
+        ::munmap(m_data, m_size);
+    }
+
+    char const* data() const
+    {
+        return m_data;
+    }
+
+    char* mutable_data()
+    {
+        ENFORCE(m_writable);
+        return m_data;
+    }
+
+    // Starts writing dirty pages back to the file
+    void flush()
+    {
+        if(m_writable)
+        {
+            ::msync(m_data, m_size, MS_ASYNC);
+        }
+    }
+
+    std::uint64_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    char* m_data;
+    std::uint64_t m_size;
+    bool m_writable = false;
+
+    // Maps the whole file and closes fd
+    void map(int fd, int prot, int flags, std::string const& path)
+    {
+        void* p = ::mmap(nullptr, m_size, prot, flags, fd, 0);
+        int e = errno;
+        ::close(fd);
+        if(p == MAP_FAILED)
+        {
+            throw std::system_error(e, std::generic_category(), "mmap " + path);
+        }
+        m_data = static_cast<char *>(p);
+    }
+};
@@ -1,16 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
 
 #include <boost/circular_buffer.hpp>
 
 #include "block.hpp"
+#include "batch.hpp"
+#include "block_cache.hpp"
+#include "decoder_service.hpp"
 #include "stream.hpp"
 #include "packet.hpp"
 #include "logic.hpp"
@@ -19,18 +25,47 @@
 #include "asio.hpp"
 
 int const LOSE_EVERY = 10;
+std::uint64_t const DEFAULT_BLOCK_CACHE_BYTES = 256 << 20;
+auto const SWEEP_INTERVAL = std::chrono::milliseconds(100);
+// A forward-only relay decodes a block its subscribers still need once
+// no packet of it has come in for this long
+auto const FORWARD_STALL_TIMEOUT = std::chrono::milliseconds(500);
+// And a block still short of symbols is asked for more once its upstreams
+// have sent nothing for this long (not just nothing of this block, which
+// may be waiting behind newer ones)
+auto const NEED_MORE_TIMEOUT = std::chrono::milliseconds(500);
 
 class Node: public AsioNode<Node>
 {
 public:
-    template <class... Args>
-    Node(Args&&... args): AsioNode(std::forward<Args>(args)...)
+    // decode_threads = 0 decodes blocks on the I/O thread.
+    // Decoded blocks are kept up to cache_bytes, for late subscribers.
+    Node(asio::io_context& io_context, int port, unsigned decode_threads = 0,
+        std::uint64_t cache_bytes = DEFAULT_BLOCK_CACHE_BYTES):
+        AsioNode(io_context, port),
+        m_decoder(io_context, decode_threads),
+        m_sweep_timer(io_context),
+        m_cache(cache_bytes, [this](BlockKey key) { forget_block(key); })
     {
     }
 
     void handle_packet(Packet p, endpoint_t peer)
     {
+        LatencyHistogram::Scope stall(m_io_stalls);
+
         auto const& h = p.header<PacketHeader>();
+
+        // Losses are simulated on data packets only, at random so that
+        // they don't line up with the order the packets are sent in
+        bool const lost =
+            (h.m_packet_type == PacketHeader::PacketType::BLOCK ||
+                h.m_packet_type == PacketHeader::PacketType::STREAM) &&
+            m_lose(m_random);
+        if(!lost && link(peer).did_receive(h.m_seq))
+        {
+            send_report(peer);
+        }
+
         switch(h.m_packet_type)
         {
         case PacketHeader::PacketType::CONTROL:
@@ -41,15 +76,35 @@ public:
                     std::cout
                         << peer
                         << " subscribed to ch = " << ch.m_channel_id
+                        << " slot=" << ch.m_slot << "/" << ch.m_n_slots
                         << std::endl;
 
-                    m_subscriptions[ch.m_channel_id].insert_or_assign(
-                        peer,
-                        make_receiver(
-                            peer,
-                            ch.m_kbps
-                        )
-                    );
+                    if(ch.m_slot >= ch.m_n_slots ||
+                        ch.m_n_slots > MAX_PARTITION_SLOTS)
+                    {
+                        std::cout << "Bad slot!" << std::endl;
+                        break;
+                    }
+                    add_subscriber(ch.m_channel_id, peer, ch.m_kbps,
+                        {ch.m_slot, ch.m_n_slots});
+
+                    // It missed the start of the blocks being forwarded,
+                    // only regenerated symbols make up for that
+                    for(auto& [key, state] : m_blocks)
+                    {
+                        if(key.first == ch.m_channel_id && !state.block)
+                        {
+                            start_decode(key, state, "late subscriber");
+                        }
+                    }
+
+                    // Late joiner, catch up on what we still have
+                    auto& subscriber = m_subscriptions[ch.m_channel_id].at(peer);
+                    m_cache.for_each(ch.m_channel_id,
+                        [&](std::uint32_t block_id, auto const&) {
+                            queue_block(peer, subscriber, ch.m_channel_id,
+                                block_id, m_blocks.at({ch.m_channel_id, block_id}));
+                        });
                 }
             }
             break;
@@ -62,52 +117,122 @@ public:
                     << " size=" << p.data().size()
                     << " ch=" << h.m_channel_id
                     << " bid=" << h.m_block_id
+                    << " prio=" << h.m_priority
                     << " bs=" << h.m_block_size
+                    << " codec=" << BlockCodecId(h.m_codec)
+                    << " content=" << h.m_content
+                    << " sb=" << h.m_sub_block
                     << " px=" << h.m_packet_index
                 ;
 
-                if(packet_seq++ % LOSE_EVERY == 0)
+                if(lost)
                 {
                     std::cout << " ...oops, lost!" << std::endl;
                     break;
                 }
                 std::cout << std::endl;
 
-                auto& block = m_blocks.try_emplace(
-                    {h.m_channel_id, h.m_block_id},
-                    h.m_block_size
-                ).first->second; // pair<iterator, bool>
-
-                bool decoded = block.process_symbol(
-                    p.payload<BlockPacketHeader>(),
-                    h.m_packet_index
-                );
+                BlockSchedule const schedule{h.m_priority, h.m_deadline_ms};
+                if(schedule.expired(wall_clock_ms()))
+                {
+                    std::cout << "Block expired!" << std::endl;
+                    break;
+                }
 
-                std::vector<Bytes> packets_to_send = {p.move_data()};
+                BlockCodecId const codec{h.m_codec};
+                if(!Block::supports(codec, h.m_block_size))
+                {
+                    std::cout << "Bad codec for block size!" << std::endl;
+                    break;
+                }
+                if(h.m_content > std::uint32_t(BlockContent::BATCH))
+                {
+                    std::cout << "Bad content!" << std::endl;
+                    break;
+                }
 
-                if(decoded)
+                if(m_evicted.count({h.m_channel_id, h.m_block_id}))
                 {
-                    std::cout << "Full block ready, crc = "
-                        << show_crc32{to_sv(block.decoded_data())}
-                        << std::endl;
+                    // Decoded long ago, the sender missed our ack
+                    send_block_ack(peer, h.m_channel_id, h.m_block_id);
+                    break;
+                }
 
-                    for(auto p : block_packet_range(block,
-                        h.m_channel_id, h.m_block_id, REDUNDANCY))
+                BlockKey const key{h.m_channel_id, h.m_block_id};
+                auto [it, is_new] = m_blocks.try_emplace(key);
+                auto& state = it->second;
+                if(is_new)
+                {
+                    state.block_size = h.m_block_size;
+                    state.codec = codec;
+                    state.content = BlockContent(h.m_content);
+                    state.schedule = schedule;
+                    state.received.emplace(h.m_block_size, codec);
+                    if(!m_forward_only)
                     {
-                        packets_to_send.push_back(p.move_data());
+                        start_decode(key, state);
                     }
+                    schedule_sweep();
                 }
+                state.last_packet = Clock::now();
+                m_last_block_packet[peer] = state.last_packet;
 
-                if(!packets_to_send.empty())
+                if(h.m_sub_block >= state.received->n_sub_blocks())
+                {
+                    std::cout << "Bad sub-block: sb=" << h.m_sub_block << std::endl;
+                    break;
+                }
+                // Past the codec's last symbol, or more than any sender of
+                // ours makes. Checked once here, before anything keeps
+                // track of it or the decoder sees it.
+                if(h.m_packet_index >= state.received->max_symbols(h.m_sub_block))
+                {
+                    std::cout << "Bad symbol index: px=" << h.m_packet_index
+                        << std::endl;
+                    break;
+                }
+                state.upstream.insert(peer);
+
+                if(state.decoded)
+                {
+                    // Our ack got lost, or crossed this packet. Subscribers
+                    // get regenerated symbols now, see queue_block().
+                    send_block_ack(peer, h.m_channel_id, h.m_block_id);
+                    break;
+                }
+
+                // The decoder must not get the same symbol twice, and
+                // there's no point in forwarding it again
+                SymbolId const id{h.m_sub_block, h.m_packet_index};
+                if(!state.received->mark(id))
+                {
+                    std::cout << "Duplicate symbol!" << std::endl;
+                    break;
+                }
+
+                auto const data = p.data();
+                for(auto& [ep, subscriber] : m_subscriptions[h.m_channel_id])
                 {
-                    for(auto& [ep, receiver] : m_subscriptions[h.m_channel_id])
+                    // Not in the subscriber's partition (its other upstreams
+                    // forward those), already sent, or over its budget
+                    auto& sent = sent_symbols(state, ep, subscriber);
+                    if(state.acked.count(ep) ||
+                        !sent.can_send(id.sub_block, link(ep).redundancy()) ||
+                        !sent.mark(id))
                     {
-                        std::cout << "Queue to " << ep << std::endl;
-                        for(auto const& p : packets_to_send)
-                        {
-                            receiver.queue_packet(p);
-                        }
+                        continue;
                     }
+                    std::cout << "Queue to " << ep << std::endl;
+                    subscriber.receiver.queue_packet({data.begin(), data.end()});
+                }
+
+                if(state.block)
+                {
+                    decode(key, state, std::move(p));
+                }
+                else
+                {
+                    state.held.push_back(std::move(p));
                 }
             }
             break;
@@ -122,7 +247,7 @@ public:
                     << " px=" << h.m_packet_index
                 ;
 
-                if(packet_seq++ % LOSE_EVERY == 0)
+                if(lost)
                 {
                     std::cout << " ...Oops, lost!" << std::endl;
                     break;
@@ -167,13 +292,13 @@ public:
 
                 if(!packets_to_send.empty())
                 {
-                    for(auto& [ep, receiver] : m_subscriptions[h.m_channel_id])
+                    for(auto& [ep, subscriber] : m_subscriptions[h.m_channel_id])
                     {
                         std::cout << "Queue to " << ep
                             << " n=" << packets_to_send.size() << std::endl;
                         for(auto const& p : packets_to_send)
                         {
-                            receiver.queue_packet(p);
+                            subscriber.receiver.queue_packet(p);
                         }
                     }
                 }
@@ -197,16 +322,625 @@ public:
             }
             break;
 
+        case PacketHeader::PacketType::BLOCK_ACK:
+            {
+                auto const& h = p.header<BlockAckPacketHeader>();
+                std::cout
+                    << "A block ack!"
+                    << " from=" << peer
+                    << " ch=" << h.m_channel_id
+                    << " bid=" << h.m_block_id
+                    << std::endl;
+
+                BlockKey const key{h.m_channel_id, h.m_block_id};
+                auto block = m_blocks.find(key);
+                if(block != m_blocks.end())
+                {
+                    auto& state = block->second;
+                    state.acked.insert(peer);
+                    if(!state.block && !needed_downstream(key, state))
+                    {
+                        release_forwarded(key, state);
+                    }
+                }
+
+                auto& subscribers = m_subscriptions[h.m_channel_id];
+                auto subscriber = subscribers.find(peer);
+                if(subscriber != subscribers.end())
+                {
+                    subscriber->second.receiver.cancel_block(h.m_channel_id,
+                        h.m_block_id);
+                }
+            }
+            break;
+
+        case PacketHeader::PacketType::NEED_MORE:
+            {
+                auto const& h = p.header<NeedMorePacketHeader>();
+                std::cout
+                    << "Need more!"
+                    << " from=" << peer
+                    << " ch=" << h.m_channel_id
+                    << " bid=" << h.m_block_id
+                    << " sb=" << h.m_sub_block
+                    << " count=" << h.m_count
+                    << std::endl;
+
+                BlockKey const key{h.m_channel_id, h.m_block_id};
+                auto block = m_blocks.find(key);
+                auto& subscribers = m_subscriptions[h.m_channel_id];
+                auto subscriber = subscribers.find(peer);
+                if(block == m_blocks.end() || subscriber == subscribers.end())
+                {
+                    std::cout << "Unknown block or subscriber!" << std::endl;
+                    break;
+                }
+
+                auto& state = block->second;
+                auto& sent = sent_symbols(state, peer, subscriber->second);
+                if(h.m_sub_block >= sent.n_sub_blocks())
+                {
+                    std::cout << "Bad sub-block: sb=" << h.m_sub_block << std::endl;
+                    break;
+                }
+                // The count is off the wire, so no more than a link's
+                // budget at MAX_REDUNDANCY, all told
+                std::uint32_t const most =
+                    sent.n_original(h.m_sub_block) * MAX_REDUNDANCY + 0.5;
+                std::uint32_t const count = std::min(h.m_count,
+                    most - std::min(most, sent.count(h.m_sub_block)));
+                if(count == 0)
+                {
+                    std::cout << "Nothing more to send!" << std::endl;
+                    break;
+                }
+                sent.grant(h.m_sub_block, count);
+
+                if(state.decoded)
+                {
+                    queue_block(peer, subscriber->second, h.m_channel_id,
+                        h.m_block_id, state);
+                }
+                else if(!state.block)
+                {
+                    // Only forwarding it, so pass the request on
+                    need_more(key, state, h.m_sub_block, count);
+                }
+                // Otherwise more will be forwarded as it comes in
+            }
+            break;
+
+        case PacketHeader::PacketType::REPORT:
+            {
+                auto const& h = p.header<ReportPacketHeader>();
+                auto& link = this->link(peer);
+                link.process_report(h.m_received, h.m_highest_seq);
+                std::cout
+                    << "A report!"
+                    << " from=" << peer
+                    << " received=" << h.m_received
+                    << " seq=" << h.m_highest_seq
+                    << " loss=" << link.loss()
+                    << " redundancy=" << link.redundancy()
+                    << std::endl;
+            }
+            break;
+
         default:
             throw std::runtime_error("Bad packet type!");
         }
     }
 
+    // Also for sending our own blocks to a relay, which then acks them here
+    AsioReceiver& add_subscriber(std::uint32_t channel_id, endpoint_t peer,
+        unsigned kbps, SymbolPartition partition = {})
+    {
+        return m_subscriptions[channel_id].insert_or_assign(
+            peer,
+            Subscriber{make_receiver(peer, kbps), partition}
+        ).first->second.receiver;
+    }
+
+    using SinkFactory = std::function<std::shared_ptr<BlockSink>(
+        std::uint32_t channel_id, std::uint32_t block_id, std::uint32_t block_size)>;
+
+    // Where received blocks are recovered to, in memory by default
+    void set_sink_factory(SinkFactory make_sink)
+    {
+        m_make_sink = std::move(make_sink);
+    }
+
+    // Sends a block of our own to the channel's subscribers. The original
+    // chunks go out right away, call publish_encoded() once the block's
+    // encoders are set for the rest.
+    void publish(std::uint32_t channel_id, std::uint32_t block_id,
+        std::shared_ptr<Block> block)
+    {
+        BlockKey const key{channel_id, block_id};
+        auto& state = m_blocks[key];
+        state.block_size = block->block_size();
+        state.codec = block->codec();
+        state.content = block->content();
+        state.schedule = block->schedule();
+        state.received.emplace(state.block_size, state.codec);
+        state.block = std::move(block);
+        state.decoded = true;
+        if(state.schedule.has_deadline())
+        {
+            schedule_sweep();
+        }
+
+        for(auto& [ep, subscriber] : m_subscriptions[channel_id])
+        {
+            queue_block(ep, subscriber, channel_id, block_id, state);
+        }
+    }
+
+    void publish_encoded(std::uint32_t channel_id, std::uint32_t block_id)
+    {
+        auto it = m_blocks.find({channel_id, block_id});
+        if(it == m_blocks.end())
+        {
+            // Expired
+            return;
+        }
+        auto& state = it->second;
+        for(auto& [ep, subscriber] : m_subscriptions[channel_id])
+        {
+            if(!state.acked.count(ep))
+            {
+                queue_block(ep, subscriber, channel_id, block_id, state);
+            }
+        }
+        m_cache.insert({channel_id, block_id}, state.block);
+    }
+
+    using ObjectHandler = std::function<void(std::uint32_t channel_id,
+        std::uint32_t block_id, std::uint32_t index, std::string_view object)>;
+
+    // Gets the objects of decoded batches, on the I/O thread. They are only
+    // valid during the call.
+    void set_object_handler(ObjectHandler on_object)
+    {
+        m_on_object = std::move(on_object);
+    }
+
+    using PrefixHandler = std::function<void(std::uint32_t channel_id,
+        std::uint32_t block_id, std::uint32_t block_size, std::string_view prefix)>;
+
+    // Gets the start of blocks still being decoded as it grows (see
+    // Block::received_prefix()), on the I/O thread every SWEEP_INTERVAL.
+    // The prefix is only valid during the call.
+    void set_prefix_handler(PrefixHandler on_prefix)
+    {
+        m_on_prefix = std::move(on_prefix);
+    }
+
+    // Pass blocks through without decoding them, unless a subscriber is
+    // short of symbols when the block stops coming in, or subscribes late.
+    // Saves the decoding and encoding when upstream redundancy covers the
+    // subscribers' losses.
+    void set_forward_only(bool forward_only)
+    {
+        m_forward_only = forward_only;
+    }
+
 private:
-    int packet_seq = 0;
+    using BlockKey = BlockCache::Key;
+
+    struct Subscriber
+    {
+        AsioReceiver receiver;
+        SymbolPartition partition;
+    };
+
+    struct RelayStats
+    {
+        std::uint64_t forwarded = 0;  // Without decoding
+        std::uint64_t decoded = 0;    // On demand
+
+        friend std::ostream& operator <<(std::ostream& os, RelayStats const& s)
+        {
+            return os
+                << "forwarded=" << s.forwarded
+                << " decoded=" << s.decoded;
+        }
+    };
+
+    struct BlockState
+    {
+        std::uint32_t block_size = 0;
+        BlockCodecId codec = BlockCodecId::WIREHAIR;
+        BlockContent content = BlockContent::RAW;
+        BlockSchedule schedule;
+        time_point_t last_packet;
+
+        // Once decoding, see start_decode(); until then the packets are held
+        std::shared_ptr<Block> block;
+        std::vector<BlockDecoderService::Strand> strands;  // Per sub-block
+        std::vector<Packet> held;
+        bool decoded = false;  // As seen by the I/O thread
+        std::uint32_t prefix_reported = 0;  // Bytes passed to m_on_prefix
+        std::set<endpoint_t> upstream;  // Peers that sent us the block
+        std::set<endpoint_t> acked;     // Subscribers that have it
+        // Each goes to the decoder once. Set for every block, also our own
+        // (see publish()), as soon as it is in m_blocks.
+        std::optional<SymbolSet> received;
+        std::map<endpoint_t, std::shared_ptr<SymbolSet>> sent;
+    };
+
+    // Runs on the I/O thread once a block's decoder has succeeded
+    void handle_block_decoded(std::uint32_t channel_id, std::uint32_t block_id)
+    {
+        LatencyHistogram::Scope stall(m_io_stalls);
+
+        auto it = m_blocks.find({channel_id, block_id});
+        if(it == m_blocks.end())
+        {
+            // Expired while it was being decoded
+            return;
+        }
+        auto& state = it->second;
+        state.decoded = true;
+        std::cout << "Full block ready, crc = "
+            << show_crc32{to_sv(state.block->decoded_data())}
+            << std::endl;
+        std::cout << "Codec pool: "
+            << WirehairCodecPool::instance().stats()
+            << std::endl;
+        std::cout << "I/O stalls: " << m_io_stalls << std::endl;
+
+        if(state.block->content() == BlockContent::BATCH)
+        {
+            // Anyone can send a block marked as a batch. A bad one is
+            // still relayed as it is, only its objects are skipped.
+            auto const objects = unpack_batch(state.block->decoded_data());
+            if(!objects)
+            {
+                std::cout << "Bad batch!" << std::endl;
+            }
+            for(std::uint32_t ix = 0; objects && ix < objects->size(); ++ix)
+            {
+                m_on_object(channel_id, block_id, ix, (*objects)[ix]);
+            }
+        }
+
+        for(auto const& peer : state.upstream)
+        {
+            send_block_ack(peer, channel_id, block_id);
+        }
+
+        for(auto& [ep, subscriber] : m_subscriptions[channel_id])
+        {
+            if(!state.acked.count(ep))
+            {
+                queue_block(ep, subscriber, channel_id, block_id, state);
+            }
+        }
+
+        // Last, this may evict older blocks and forget their state (never
+        // this block's, the cache always keeps its newest one)
+        m_cache.insert({channel_id, block_id}, state.block);
+        std::cout << "Block cache: " << m_cache.stats()
+            << " in_progress=" << m_blocks.size() - m_cache.stats().blocks
+            << std::endl;
+    }
+
+    // What was sent of the block to the subscriber, starting over if it
+    // has subscribed again with another partition
+    SymbolSet& sent_symbols(BlockState& state, endpoint_t const& ep,
+        Subscriber const& subscriber)
+    {
+        auto& sent = state.sent[ep];
+        auto const& partition = subscriber.partition;
+        if(!sent || sent->partition().slot != partition.slot ||
+            sent->partition().n_slots != partition.n_slots)
+        {
+            sent = std::make_shared<SymbolSet>(state.block_size, state.codec,
+                partition);
+        }
+        return *sent;
+    }
+
+    // Sends the rest of a block's budget, see unsent_packet_source()
+    void queue_block(endpoint_t const& ep, Subscriber& subscriber,
+        std::uint32_t channel_id, std::uint32_t block_id, BlockState& state)
+    {
+        std::cout << "Queue to " << ep << " bid=" << block_id << std::endl;
+        sent_symbols(state, ep, subscriber);
+        subscriber.receiver.add_source(unsent_packet_source(state.block,
+            channel_id, block_id, state.sent.at(ep), [&link = link(ep)] {
+                return link.redundancy();
+            }), block_tag(channel_id, block_id),
+            block_packet_priority(state.schedule.priority));
+    }
+
+    // Creates the block and its decoders, and feeds them what was held
+    void start_decode(BlockKey key, BlockState& state, char const* why = nullptr)
+    {
+        if(why)
+        {
+            std::cout << "Decoding forwarded block"
+                << " ch=" << key.first << " bid=" << key.second
+                << " held=" << state.held.size()
+                << ": " << why << std::endl;
+            ++m_relay_stats.decoded;
+        }
+        state.block = std::make_shared<Block>(state.block_size, state.codec,
+            m_make_sink(key.first, key.second, state.block_size));
+        state.block->set_schedule(state.schedule);
+        state.block->set_content(state.content);
+        for(std::uint32_t sb = 0; sb < state.block->n_sub_blocks(); ++sb)
+        {
+            state.strands.push_back(m_decoder.make_strand());
+        }
+
+        auto held = std::move(state.held);
+        state.held = {};
+        for(auto& packet : held)
+        {
+            decode(key, state, std::move(packet));
+        }
+    }
+
+    void decode(BlockKey key, BlockState& state, Packet packet)
+    {
+        auto const sub_block = packet.header<BlockPacketHeader>().m_sub_block;
+        m_decoder.decode(state.strands[sub_block], state.block,
+            std::move(packet), [this, key]() {
+                handle_block_decoded(key.first, key.second);
+            });
+    }
+
+    // Whether a subscriber still lacks the block
+    bool needed_downstream(BlockKey key, BlockState const& state)
+    {
+        for(auto const& [ep, subscriber] : m_subscriptions[key.first])
+        {
+            if(!state.acked.count(ep))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A forwarded block that no subscriber needs any more
+    void release_forwarded(BlockKey key, BlockState const& state)
+    {
+        std::cout << "Forwarded block without decoding"
+            << " ch=" << key.first << " bid=" << key.second
+            << std::endl;
+        ++m_relay_stats.forwarded;
+        std::cout << "Relay: " << m_relay_stats << std::endl;
+
+        for(auto const& peer : state.upstream)
+        {
+            send_block_ack(peer, key.first, key.second);
+        }
+        forget_block(key);
+    }
+
+    // Asks the upstreams for count more symbols of the sub-block,
+    // each for its share
+    void need_more(BlockKey key, BlockState const& state,
+        std::uint32_t sub_block, std::uint32_t count)
+    {
+        if(state.upstream.empty())
+        {
+            return;
+        }
+        std::uint32_t const share =
+            (count + state.upstream.size() - 1) / state.upstream.size();
+        for(auto const& peer : state.upstream)
+        {
+            send_bytes(peer, Packet::make<NeedMorePacketHeader>({},
+                key.first, key.second, sub_block, share).move_data());
+        }
+    }
+
+    // What the decoder is short of: the missing original chunk count, or
+    // one more if it has that many and still can't decode (wirehair needs
+    // a few extra now and then). A sub-block that did decode gets one too,
+    // the I/O thread doesn't know which ones did.
+    void need_more(BlockKey key, BlockState const& state)
+    {
+        auto const& received = *state.received;
+        for(std::uint32_t sb = 0; sb < received.n_sub_blocks(); ++sb)
+        {
+            std::uint32_t const have = received.count(sb);
+            std::uint32_t const n_original = received.n_original(sb);
+            std::uint32_t const count = have < n_original ? n_original - have : 1;
+            std::cout << "Need more"
+                << " ch=" << key.first << " bid=" << key.second
+                << " sb=" << sb << " count=" << count
+                << std::endl;
+            need_more(key, state, sb, count);
+        }
+    }
+
+    bool upstreams_quiet(BlockState const& state, time_point_t since) const
+    {
+        return std::all_of(state.upstream.begin(), state.upstream.end(),
+            [&](endpoint_t const& peer) {
+                return m_last_block_packet.at(peer) <= since;
+            });
+    }
+
+    // Looks at the blocks every so often, as long as some have a deadline
+    // or haven't been decoded
+    void schedule_sweep()
+    {
+        if(m_sweep_pending)
+        {
+            return;
+        }
+        m_sweep_pending = true;
+        m_sweep_timer.expires_after(SWEEP_INTERVAL);
+        m_sweep_timer.async_wait([this](error_code ec) {
+            enforce_ec(ec);
+            m_sweep_pending = false;
+            sweep_blocks();
+        });
+    }
+
+    void report_prefix(BlockKey const& key, BlockState& state)
+    {
+        auto const prefix = state.block->received_prefix();
+        if(prefix.size() > state.prefix_reported)
+        {
+            state.prefix_reported = prefix.size();
+            m_on_prefix(key.first, key.second, state.block_size, prefix);
+        }
+    }
+
+    void sweep_blocks()
+    {
+        expire_blocks();
+
+        auto const now = Clock::now();
+        auto const stalled = now - FORWARD_STALL_TIMEOUT;
+        std::vector<BlockKey> released;
+        bool again = false;
+        for(auto& [key, state] : m_blocks)
+        {
+            again = again || state.schedule.has_deadline() || !state.decoded;
+            if(state.block && !state.decoded)
+            {
+                report_prefix(key, state);
+            }
+            bool const short_of_symbols = !state.decoded &&
+                state.last_packet <= now - NEED_MORE_TIMEOUT &&
+                upstreams_quiet(state, now - NEED_MORE_TIMEOUT) &&
+                (state.block || !state.received->covers_originals());
+            if(short_of_symbols)
+            {
+                need_more(key, state);
+                state.last_packet = now;  // Give them time to arrive
+                continue;
+            }
+            if(state.block)
+            {
+                continue;
+            }
+            // Lower priority blocks stall too, and a decode can't finish
+            // without enough symbols anyway
+            if(state.last_packet > stalled || !state.received->covers_originals())
+            {
+                again = true;
+            }
+            else if(needed_downstream(key, state))
+            {
+                start_decode(key, state, "stalled short of a subscriber");
+            }
+            else
+            {
+                released.push_back(key);
+            }
+        }
+
+        for(auto const& key : released)
+        {
+            release_forwarded(key, m_blocks.at(key));
+        }
+
+        if(again)
+        {
+            schedule_sweep();
+        }
+    }
+
+    // Drops expired blocks, decoded or not, and whatever is still queued
+    // for them. Late packets of these are dropped on arrival.
+    void expire_blocks()
+    {
+        std::uint32_t const now = wall_clock_ms();
+        std::vector<BlockKey> expired;
+        for(auto const& [key, state] : m_blocks)
+        {
+            if(state.schedule.expired(now))
+            {
+                expired.push_back(key);
+            }
+        }
+
+        for(auto const& key : expired)
+        {
+            auto const [channel_id, block_id] = key;
+            std::cout << "Expired block ch=" << channel_id
+                << " bid=" << block_id
+                << " decoded=" << m_blocks.at(key).decoded
+                << std::endl;
+
+            for(auto& [ep, subscriber] : m_subscriptions[channel_id])
+            {
+                subscriber.receiver.cancel_block(channel_id, block_id);
+            }
+            m_cache.erase(key);
+            forget_block(key);
+        }
+    }
+
+    // The block was evicted from the cache, expired, or was forwarded
+    void forget_block(BlockKey key)
+    {
+        m_blocks.erase(key);
+
+        if(m_evicted_order.full())
+        {
+            m_evicted.erase(m_evicted_order.front());
+        }
+        m_evicted_order.push_back(key);
+        m_evicted.insert(key);
+    }
+
+    void send_block_ack(endpoint_t const& peer,
+        std::uint32_t channel_id, std::uint32_t block_id)
+    {
+        send_bytes(peer, Packet::make<BlockAckPacketHeader>({},
+            channel_id, block_id).move_data());
+    }
+
+    void send_report(endpoint_t const& peer)
+    {
+        auto const& link = this->link(peer);
+        send_bytes(peer, Packet::make<ReportPacketHeader>({},
+            link.received(), link.highest_received_seq()).move_data());
+    }
+
+    BlockDecoderService m_decoder;
+    Timer m_sweep_timer;
+    bool m_sweep_pending = false;
+    bool m_forward_only = false;
+    SinkFactory m_make_sink = [](std::uint32_t, std::uint32_t, std::uint32_t size) {
+        return std::make_shared<MemoryBlockSink>(size);
+    };
+    ObjectHandler m_on_object = [](std::uint32_t channel_id,
+        std::uint32_t block_id, std::uint32_t index, std::string_view object) {
+        std::cout << "Object ch=" << channel_id << " bid=" << block_id
+            << " ix=" << index << " size=" << object.size()
+            << " crc=" << show_crc32{object} << std::endl;
+    };
+    PrefixHandler m_on_prefix = [](std::uint32_t channel_id,
+        std::uint32_t block_id, std::uint32_t block_size, std::string_view prefix) {
+        std::cout << "Block prefix ch=" << channel_id << " bid=" << block_id
+            << " bytes=" << prefix.size() << "/" << block_size << std::endl;
+    };
+    LatencyHistogram m_io_stalls;
+    std::mt19937 m_random = make_random_engine<std::mt19937>();
+    std::bernoulli_distribution m_lose{1.0 / LOSE_EVERY};
     std::unordered_map<std::uint32_t,
-        std::map<udp::endpoint, AsioReceiver>> m_subscriptions;
-    std::unordered_map<std::pair<std::uint32_t, std::uint32_t>, Block,
-        boost::hash<std::pair<std::uint32_t, std::uint32_t>>> m_blocks;
+        std::map<udp::endpoint, Subscriber>> m_subscriptions;
+    std::unordered_map<BlockKey, BlockState, boost::hash<BlockKey>> m_blocks;
     std::unordered_map<std::uint32_t, ContinuousStream> m_streams;
+    RelayStats m_relay_stats;  // Forward-only blocks
+    std::map<endpoint_t, time_point_t> m_last_block_packet;  // By upstream
+
+    // Blocks evicted from the cache, remembered for a while so that late
+    // packets for them aren't decoded all over again
+    static std::size_t const MAX_EVICTED = 4096;
+    boost::circular_buffer<BlockKey> m_evicted_order{MAX_EVICTED};
+    std::unordered_set<BlockKey, boost::hash<BlockKey>> m_evicted;
+
+    BlockCache m_cache;  // Of the decoded m_blocks
 };
@@ -18,15 +18,24 @@ struct PacketHeader
         STREAM,
         STREAM_ACK,
         BLOCK,
+        REPORT,
+        BLOCK_ACK,
+        NEED_MORE,
         CONTROL,
     } m_packet_type;
+    std::uint32_t m_seq;  // Per link, set when sent
 };
 
 struct BlockPacketHeader: PacketHeader
 {
     std::uint32_t m_channel_id;
     std::uint32_t m_block_id;
+    std::uint32_t m_priority;     // BlockSchedule
+    std::uint32_t m_deadline_ms;
     std::uint32_t m_block_size;
+    std::uint32_t m_codec;  // BlockCodecId
+    std::uint32_t m_content;  // BlockContent
+    std::uint32_t m_sub_block;
     std::uint32_t m_packet_index;
 
     static auto const PACKET_TYPE = PacketType::BLOCK;
@@ -47,6 +56,37 @@ struct StreamAckPacketHeader: PacketHeader
     static auto const PACKET_TYPE = PacketType::STREAM_ACK;
 };
 
+// Receiver report: of the packets with m_seq up to m_highest_seq,
+// the sender's peer got m_received (both cumulative)
+struct ReportPacketHeader: PacketHeader
+{
+    std::uint32_t m_received;
+    std::uint32_t m_highest_seq;
+
+    static auto const PACKET_TYPE = PacketType::REPORT;
+};
+
+// The sender has decoded the block, sending more of it is a waste
+struct BlockAckPacketHeader: PacketHeader
+{
+    std::uint32_t m_channel_id;
+    std::uint32_t m_block_id;
+
+    static auto const PACKET_TYPE = PacketType::BLOCK_ACK;
+};
+
+// The sender's decoder expects to need m_count more symbols of the sub-block,
+// e.g. because the losses outran the redundancy
+struct NeedMorePacketHeader: PacketHeader
+{
+    std::uint32_t m_channel_id;
+    std::uint32_t m_block_id;
+    std::uint32_t m_sub_block;
+    std::uint32_t m_count;
+
+    static auto const PACKET_TYPE = PacketType::NEED_MORE;
+};
+
 struct ControlPacketHeader: PacketHeader
 {
     enum class Action: std::uint32_t
@@ -56,6 +96,8 @@ struct ControlPacketHeader: PacketHeader
     } m_action;
     std::uint32_t m_channel_id;
     std::uint32_t m_kbps;
+    std::uint32_t m_slot;     // SymbolPartition of the subscriber
+    std::uint32_t m_n_slots;  // among its upstreams
 
     static auto const PACKET_TYPE = PacketType::CONTROL;
 };
@@ -63,6 +105,31 @@ struct ControlPacketHeader: PacketHeader
 static_assert(MAX_BLOCK_PACKET_SIZE + sizeof(BlockPacketHeader) == MAX_PACKET_SIZE);
 static_assert(MAX_STREAM_PACKET_SIZE + sizeof(StreamPacketHeader) == MAX_PACKET_SIZE);
 
+// Identifies a block's packet sources in a queue
+inline std::uint64_t block_tag(std::uint32_t channel_id, std::uint32_t block_id)
+{
+    return std::uint64_t(channel_id) << 32 | block_id;
+}
+
+// Rank of a packet in the egress queues, higher goes first: by packet type,
+// then BLOCK packets by their block's priority
+inline std::uint64_t block_packet_priority(std::uint32_t block_priority)
+{
+    return std::uint64_t(PacketHeader::PacketType::BLOCK) << 32 | block_priority;
+}
+
+inline std::uint64_t packet_priority(std::vector<char> const& packet)
+{
+    ENFORCE(packet.size() >= sizeof(PacketHeader));
+    auto const* h = reinterpret_cast<PacketHeader const *>(packet.data());
+    if(h->m_packet_type == PacketHeader::PacketType::BLOCK)
+    {
+        return block_packet_priority(
+            static_cast<BlockPacketHeader const *>(h)->m_priority);
+    }
+    return std::uint64_t(h->m_packet_type) << 32;
+}
+
 class Packet
 {
 public:
@@ -90,11 +157,29 @@ public:
     static Packet make(std::string_view payload, Args const&... args)
     {
         return Packet(Header{
-            { 0u, Header::PACKET_TYPE },
+            { 0u, Header::PACKET_TYPE, 0u },
             args...
         }, payload);
     }
 
+    // Makes a packet with room for up to max_payload bytes after the header
+    // and lets fill(char* payload, std::size_t capacity) write the payload
+    // in place. fill returns the number of payload bytes it has written.
+    template <class Header, class Fill, class... Args>
+    static Packet make_in_place(std::size_t max_payload, Fill&& fill,
+        Args const&... args)
+    {
+        Packet packet(std::vector<char>(sizeof(Header) + max_payload));
+        packet.header<Header>() = Header{
+            { 0u, Header::PACKET_TYPE, 0u },
+            args...
+        };
+        std::size_t const payload_size =
+            fill(&packet.m_data[sizeof(Header)], max_payload);
+        packet.m_data.resize(sizeof(Header) + payload_size);
+        return packet;
+    }
+
     template <class Header>
     Header& header()
     {
@@ -137,6 +222,12 @@ public:
 
         if(x.header<PacketHeader>().m_packet_type == PacketHeader::PacketType::BLOCK)
         {
+            auto const& xh = x.header<BlockPacketHeader>();
+            auto const& yh = y.header<BlockPacketHeader>();
+            if(xh.m_priority != yh.m_priority)
+            {
+                return xh.m_priority < yh.m_priority;
+            }
             return
                 y.header<BlockPacketHeader>().m_packet_index <
                 x.header<BlockPacketHeader>().m_packet_index
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "utility.hpp"
+
+// Destination of a received block.
+// Original chunks are written into data() as they arrive, the missing ones
+// once the block can be decoded; then finish() is called.
+class BlockSink
+{
+public:
+    virtual ~BlockSink() = default;
+
+    // block_size bytes, valid as long as the sink
+    virtual char* data() = 0;
+
+    // Called once the whole block is in data(), on a decoder thread
+    virtual void finish()
+    {
+    }
+};
+
+class MemoryBlockSink: public BlockSink
+{
+public:
+    explicit MemoryBlockSink(std::uint32_t block_size): m_data(block_size)
+    {
+    }
+
+    char* data() override
+    {
+        return m_data.data();
+    }
+
+private:
+    std::vector<char> m_data;
+};
+
+// Recovers the block directly into a memory-mapped file
+class FileBlockSink: public BlockSink
+{
+public:
+    FileBlockSink(std::string const& path, std::uint32_t block_size):
+        m_file(path, block_size)
+    {
+    }
+
+    char* data() override
+    {
+        return m_file.mutable_data();
+    }
+
+    void finish() override
+    {
+        m_file.flush();
+    }
+
+private:
+    MappedFile m_file;
+};
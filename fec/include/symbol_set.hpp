@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "block.hpp"
+#include "utility.hpp"
+
+// A set of symbols of a block, e.g. those sent to a subscriber, so that a
+// relay never sends it the same one twice. Only indices in the partition
+// are tracked, one bit each (index = slot + bit * n_slots), so the lowest
+// unmarked index is found a 64-bit word at a time. Indices past
+// BlockFec::max_symbols() are never marked.
+class SymbolSet
+{
+public:
+    // Of a block of this size, which needn't exist yet
+    SymbolSet(std::uint32_t block_size, BlockCodecId codec,
+        SymbolPartition partition = {}):
+        m_partition(partition)
+    {
+        ENFORCE(partition.slot < partition.n_slots);
+        for(std::uint32_t n_original : Block::n_originals(block_size))
+        {
+            auto& sb = m_sub_blocks.emplace_back();
+            sb.n_original = n_original;
+            sb.max_symbols = BlockFec::max_symbols(codec, n_original);
+        }
+    }
+
+    std::uint32_t n_sub_blocks() const
+    {
+        return m_sub_blocks.size();
+    }
+
+    SymbolPartition const& partition() const
+    {
+        return m_partition;
+    }
+
+    // Symbol indices of the sub-block are below this
+    std::uint32_t max_symbols(std::uint32_t sub_block) const
+    {
+        return m_sub_blocks.at(sub_block).max_symbols;
+    }
+
+    // Symbols marked of the sub-block
+    std::uint32_t count(std::uint32_t sub_block) const
+    {
+        return m_sub_blocks.at(sub_block).count;
+    }
+
+    // Whether every sub-block has as many symbols as original chunks,
+    // about what decoding the block takes
+    bool covers_originals() const
+    {
+        return std::all_of(m_sub_blocks.begin(), m_sub_blocks.end(),
+            [](SubBlock const& sb) { return sb.count >= sb.n_original; });
+    }
+
+    std::uint32_t n_original(std::uint32_t sub_block) const
+    {
+        return m_sub_blocks.at(sub_block).n_original;
+    }
+
+    // Whether the sub-block's budget, redundancy times its original chunks
+    // or what was granted, has room for another symbol
+    bool can_send(std::uint32_t sub_block, float redundancy) const
+    {
+        auto const& sb = m_sub_blocks.at(sub_block);
+        return sb.count < std::max(sb.granted,
+            std::uint32_t(sb.n_original * redundancy + 0.5));
+    }
+
+    // Lets count more symbols of the sub-block be sent than have been so
+    // far, e.g. when the subscriber asks for more. Asking again before they
+    // have gone out doesn't add up.
+    void grant(std::uint32_t sub_block, std::uint32_t count)
+    {
+        auto& sb = m_sub_blocks.at(sub_block);
+        // Saturating, count is off the wire
+        count = std::min(count,
+            std::numeric_limits<std::uint32_t>::max() - sb.count);
+        sb.granted = std::max(sb.granted, sb.count + count);
+    }
+
+    // Returns false if the symbol was marked before, isn't in the partition
+    // or doesn't exist
+    bool mark(SymbolId id)
+    {
+        auto& sb = m_sub_blocks.at(id.sub_block);
+        if(id.index >= sb.max_symbols ||
+            id.index % m_partition.n_slots != m_partition.slot)
+        {
+            return false;
+        }
+        std::uint32_t const bit = id.index / m_partition.n_slots;
+        std::uint32_t const word = bit / 64;
+        std::uint64_t const mask = std::uint64_t(1) << bit % 64;
+        if(word >= sb.words.size())
+        {
+            sb.words.resize(word + 1);
+        }
+        if(sb.words[word] & mask)
+        {
+            return false;
+        }
+        sb.words[word] |= mask;
+        ++sb.count;
+        return true;
+    }
+
+    // The lowest unmarked index of the partition.
+    // Original chunks come first, they need no encoding.
+    std::uint32_t lowest_unmarked(std::uint32_t sub_block)
+    {
+        auto& sb = m_sub_blocks.at(sub_block);
+        // Words below first_open are full, bits are never cleared
+        while(sb.first_open < sb.words.size() && ~sb.words[sb.first_open] == 0)
+        {
+            ++sb.first_open;
+        }
+        std::uint64_t const word = sb.first_open < sb.words.size() ?
+            sb.words[sb.first_open] : 0;
+        unsigned const bit = __builtin_ctzll(~word);
+        return (sb.first_open * 64 + bit) * m_partition.n_slots + m_partition.slot;
+    }
+
+    std::uint32_t mark_lowest(std::uint32_t sub_block)
+    {
+        std::uint32_t const index = lowest_unmarked(sub_block);
+        mark({sub_block, index});
+        return index;
+    }
+
+private:
+    struct SubBlock
+    {
+        std::uint32_t n_original = 0;
+        std::uint32_t max_symbols = 0;
+        std::uint32_t count = 0;
+        std::uint32_t granted = 0;
+        std::uint32_t first_open = 0;  // Word
+        std::vector<std::uint64_t> words;
+    };
+
+    SymbolPartition m_partition;
+    std::vector<SubBlock> m_sub_blocks;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <iterator>
@@ -22,13 +23,17 @@
 #include <iomanip>
 
 std::uint32_t const MAX_PACKET_SIZE = 1400;
-std::uint32_t const MAX_BLOCK_PACKET_SIZE = MAX_PACKET_SIZE - 6 * sizeof(std::uint32_t);
-std::uint32_t const MAX_STREAM_PACKET_SIZE = MAX_PACKET_SIZE - 4 * sizeof(std::uint32_t);
+std::uint32_t const MAX_BLOCK_PACKET_SIZE = MAX_PACKET_SIZE - 12 * sizeof(std::uint32_t);
+std::uint32_t const MAX_STREAM_PACKET_SIZE = MAX_PACKET_SIZE - 5 * sizeof(std::uint32_t);
 
 int const MAX_BLOCK_PACKET_SIZE_MIN = 10;
 int const MAX_BLOCK_PACKET_SIZE_MAX = MAX_BLOCK_PACKET_SIZE;
 
-float const REDUNDANCY = 1.3;
+float const REDUNDANCY = 1.1;           // Until the link's loss is known
+float const REDUNDANCY_MARGIN = 0.05;   // On top of what the loss takes
+float const MAX_REDUNDANCY = 3;
+// Most upstreams a subscriber may split a block's symbols among
+std::uint32_t const MAX_PARTITION_SLOTS = 16;
 
 #define ENFORCE(_expr_) (void)((_expr_) || (throw std::runtime_error( \
     __FILE__ ":" BOOST_PP_STRINGIZE(__LINE__) " " #_expr_), 0))
@@ -45,6 +50,14 @@ using Clock = std::chrono::high_resolution_clock;
 using time_point_t = std::chrono::time_point<Clock>;
 static auto const FAR_FUTURE = time_point_t::max();
 
+// Wall clock time in milliseconds, wrapping around every 49 days. Unlike
+// Clock, it means the same on every node (with synchronized clocks).
+inline std::uint32_t wall_clock_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 template <
     class T,
     class Container = std::vector<T>,
@@ -65,6 +78,13 @@ public:
         return value;
     }
 
+    template <class Pred>
+    void remove_if(Pred pred)
+    {
+        c.erase(std::remove_if(c.begin(), c.end(), pred), c.end());
+        std::make_heap(c.begin(), c.end(), comp);
+    }
+
     friend T pop_value(movable_priority_queue& q)
     {
         return q.pop_value();
@@ -206,7 +226,7 @@ Engine make_random_engine()
     return Engine(ss);
 }
 
-static Bytes random_chunk()
+inline Bytes random_chunk()
 {
     static auto engine = make_random_engine<std::mt19937>();
     //static auto engine = std::mt19937();
@@ -219,6 +239,67 @@ static Bytes random_chunk()
     return chunk;
 }
 
+// Counts durations in power-of-two microsecond buckets
+class LatencyHistogram
+{
+public:
+    static unsigned const N_BUCKETS = 24;
+
+    // Records the time until it goes out of scope
+    class Scope
+    {
+    public:
+        explicit Scope(LatencyHistogram& histogram):
+            m_histogram(histogram),
+            m_start(Clock::now())
+        {
+        }
+
+        Scope(Scope const &) = delete;
+
+        ~Scope()
+        {
+            m_histogram.record(Clock::now() - m_start);
+        }
+
+    private:
+        LatencyHistogram& m_histogram;
+        time_point_t m_start;
+    };
+
+    void record(Clock::duration d)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        unsigned bucket = 0;  // [0, 1us), then [2^(b-1), 2^b)
+        while(bucket + 1 < N_BUCKETS && (1ll << bucket) <= us)
+        {
+            ++bucket;
+        }
+        ++m_buckets[bucket];
+        ++m_count;
+        m_max = std::max(m_max, d);
+    }
+
+    friend std::ostream& operator <<(std::ostream& os, LatencyHistogram const& h)
+    {
+        os << "n=" << h.m_count << " max_us="
+            << std::chrono::duration_cast<std::chrono::microseconds>(h.m_max).count();
+        for(unsigned b = 0; b < N_BUCKETS; ++b)
+        {
+            if(h.m_buckets[b])
+            {
+                os << " <" << (1ll << b) << "us:" << h.m_buckets[b];
+            }
+        }
+        return os;
+    }
+
+private:
+    std::array<std::uint64_t, N_BUCKETS> m_buckets = {};
+    std::uint64_t m_count = 0;
+    Clock::duration m_max = {};
+};
+
 template <class Int>
 Int ceil(boost::rational<Int> r)
 {
@@ -1,16 +1,69 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+
 #include "packet.hpp"
 #include "block.hpp"
+#include "logic.hpp"
+#include "symbol_set.hpp"
 #include "utility.hpp"
 
-auto block_packet_range(Block& block,
-    std::uint32_t channel_id, std::uint32_t block_id, float redundancy)
+Packet symbol_packet(Block& block,
+    std::uint32_t channel_id, std::uint32_t block_id, SymbolId id)
+{
+    return Packet::make_in_place<BlockPacketHeader>(
+        Packet::MAX_PAYLOAD_SIZE,
+        [&](char* payload, std::size_t capacity) {
+            return block.write_symbol(id, payload, capacity);
+        },
+        channel_id, block_id, block.schedule().priority,
+        block.schedule().deadline_ms, block.block_size(), std::uint32_t(block.codec()),
+        std::uint32_t(block.content()),
+        id.sub_block, id.index);
+}
+
+// Redundancy to send a block with, e.g. that of the subscriber's link.
+// It is asked again for every packet; the number of symbols to send
+// follows it up, but not back down below what was already promised.
+using RedundancyFn = std::function<float()>;
+
+// Packets of a block for the symbols the subscriber hasn't been sent,
+// lowest index first, taking turns between sub-blocks. The budget of a
+// sub-block, to() times its original chunks plus what the subscriber asked
+// for, includes what was sent before, e.g. forwarded as it came in.
+// Until the block can encode, only the original chunks are sent. None are
+// sent past the codec's last symbol, see BlockFec::max_symbols().
+// Each packet is generated only when it is pulled, so a queue holds
+// at most one of them whatever the block size. Runs dry once the block
+// has expired.
+PacketSource unsent_packet_source(std::shared_ptr<Block> block,
+    std::uint32_t channel_id, std::uint32_t block_id,
+    std::shared_ptr<SymbolSet> sent, RedundancyFn to)
 {
-    return block.unseen_range(block.n_original() * redundancy + 0.5)
-        | boost::adaptors::transformed([=, &block](auto pair) {
-            auto& [bytes, index] = pair;
-            return Packet::make<BlockPacketHeader>(to_sv(bytes),
-                channel_id, block_id, block.block_size(), index);
-        });
+    return [block = std::move(block), sent = std::move(sent), sub_block = 0u,
+        limit = 0.f, channel_id, block_id, to]() mutable -> std::optional<Bytes>
+    {
+        limit = std::max(limit, to());
+        if(block->schedule().expired(wall_clock_ms()))
+        {
+            return std::nullopt;
+        }
+        bool const can_encode = block->can_encode();
+        for(std::uint32_t n = block->n_sub_blocks(); n > 0; --n)
+        {
+            std::uint32_t const sb = sub_block;
+            sub_block = (sub_block + 1) % block->n_sub_blocks();
+            std::uint32_t const index = sent->lowest_unmarked(sb);
+            if(sent->can_send(sb, limit) && index < sent->max_symbols(sb) &&
+                (can_encode || index < sent->n_original(sb)))
+            {
+                return symbol_packet(*block, channel_id, block_id,
+                    {sb, sent->mark_lowest(sb)}).move_data();
+            }
+        }
+        return std::nullopt;
+    };
 }
@@ -0,0 +1,122 @@
+// Where Cauchy Reed-Solomon stops being cheaper than wirehair.
+// For each N, codes a block of N full chunks the way a publisher and a relay
+// would. The encoder is solved and produces N * REDUNDANCY symbols; the
+// decoder gets them with some loss, then recovers the missing chunks. Prints
+// the time per block on each side and how many symbols beyond N the decoder
+// needed.
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include "fec.hpp"
+#include "utility.hpp"
+
+int const ROUNDS = 200;
+float const LOSS = 0.1;
+
+struct Result
+{
+    double encode_us = 0;
+    double decode_us = 0;
+    double extra_symbols = 0;
+};
+
+double us_since(time_point_t start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+Result run(BlockCodecId codec, std::uint32_t n)
+{
+    std::mt19937 random(n);
+    std::bernoulli_distribution lose(LOSS);
+
+    std::vector<char> block(std::size_t(n) * MAX_BLOCK_PACKET_SIZE);
+    for(char& c : block)
+    {
+        c = random();
+    }
+    std::uint32_t const n_sent = n * REDUNDANCY + 0.5;
+    std::vector<Bytes> symbols(n_sent, Bytes(MAX_BLOCK_PACKET_SIZE));
+    std::vector<char> out(block.size());
+
+    Result result;
+    for(int round = 0; round < ROUNDS; ++round)
+    {
+        auto start = Clock::now();
+        BlockFec encoder(to_sv(block), codec);
+        for(std::uint32_t ix = 0; ix < n_sent; ++ix)
+        {
+            symbols[ix].resize(encoder.encode_symbol(ix,
+                symbols[ix].data(), MAX_BLOCK_PACKET_SIZE));
+        }
+        result.encode_us += us_since(start);
+
+        start = Clock::now();
+        BlockFec decoder(block.size(), codec);
+        std::uint32_t received = 0;
+        bool decoded = false;
+        for(std::uint32_t ix = 0; !decoded; ++ix)
+        {
+            if(ix < n_sent && lose(random))
+            {
+                continue;
+            }
+            if(ix >= n_sent)
+            {
+                // Ran out, more than the redundancy was lost
+                symbols.emplace_back(MAX_BLOCK_PACKET_SIZE);
+                symbols[ix].resize(encoder.encode_symbol(ix,
+                    symbols[ix].data(), MAX_BLOCK_PACKET_SIZE));
+            }
+            ++received;
+            decoded = decoder.process_symbol(to_sv(symbols[ix]), ix);
+        }
+        decoder.recover(out.data());
+        result.decode_us += us_since(start);
+        symbols.resize(n_sent);
+
+        ENFORCE(out == block);
+        result.extra_symbols += received - n;
+    }
+
+    result.encode_us /= ROUNDS;
+    result.decode_us /= ROUNDS;
+    result.extra_symbols /= ROUNDS;
+    return result;
+}
+
+int main()
+{
+    fec_init();
+
+    std::cout
+        << std::setw(6) << "N"
+        << std::setw(12) << "wh_enc_us"
+        << std::setw(12) << "wh_dec_us"
+        << std::setw(12) << "wh_extra"
+        << std::setw(12) << "rs_enc_us"
+        << std::setw(12) << "rs_dec_us"
+        << std::setw(12) << "rs_extra"
+        << std::endl;
+
+    for(std::uint32_t n : {2, 4, 8, 12, 16, 24, 32, 48, 64, 96, 128})
+    {
+        Result w = run(BlockCodecId::WIREHAIR, n);
+        Result c = run(BlockCodecId::CAUCHY, n);
+        std::cout << std::fixed << std::setprecision(2)
+            << std::setw(6) << n
+            << std::setw(12) << w.encode_us
+            << std::setw(12) << w.decode_us
+            << std::setw(12) << w.extra_symbols
+            << std::setw(12) << c.encode_us
+            << std::setw(12) << c.decode_us
+            << std::setw(12) << c.extra_symbols
+            << std::endl;
+    }
+
+    return 0;
+}
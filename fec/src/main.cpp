@@ -1,11 +1,16 @@
 #include <iostream>
+#include <limits>
+#include <optional>
 #include <string>
 
 #include <boost/program_options.hpp>
 
+#include "encoder_service.hpp"
 #include "fec.hpp"
+#include "mapped_file.hpp"
 #include "stream.hpp"
 #include "net.hpp"
+#include "batch.hpp"
 
 
 namespace po = boost::program_options;
@@ -19,9 +24,32 @@ int main(int argc, char** argv)
         ("help,h", "help")
         ("action,a", po::value<std::string>(), "action")
         ("port,p", po::value<int>(), "port")
-        ("connect,c", po::value<int>(), "server port")
+        ("connect,c", po::value<std::vector<int>>()->composing(),
+            "server port, subscribe can take several")
         ("kbps,k", po::value<unsigned>(), "bandwidth")
         ("size,s", po::value<int>(), "packet size")
+        ("blocks,n", po::value<int>()->default_value(1),
+            "number of blocks, or of objects")
+        ("file,f", po::value<std::string>(), "publish this file as the block")
+        ("batch-bytes", po::value<unsigned>()->default_value(64 << 10),
+            "objects: send a batch once it is this big")
+        ("batch-ms", po::value<unsigned>()->default_value(20),
+            "objects: or once its first object has waited this long")
+        ("ttl-ms", po::value<unsigned>()->default_value(0),
+            "drop published blocks this long after they were created, 0 never")
+        ("output-dir,o", po::value<std::string>(),
+            "write received blocks to files in this directory")
+        ("threads,t", po::value<unsigned>()->default_value(
+            std::thread::hardware_concurrency()), "encoder threads")
+        ("decode-threads,d", po::value<unsigned>()->default_value(
+            std::thread::hardware_concurrency()),
+            "decoder threads, 0 to decode on the I/O thread")
+        ("stripe-threads", po::value<unsigned>()->default_value(1),
+            "threads for each wirehair solve, for few large sub-blocks")
+        ("forward-only", "relay blocks without decoding them unless needed")
+        ("cache-mb", po::value<std::uint64_t>()->default_value(
+            DEFAULT_BLOCK_CACHE_BYTES >> 20),
+            "memory for decoded blocks kept for late subscribers")
     ;
     po::variables_map options;
     po::store(po::parse_command_line(argc, argv, desc), options);
@@ -38,40 +66,120 @@ int main(int argc, char** argv)
         auto action = options.at("action").as<std::string>();
         int port = options.at("port").as<int>();
 
-        fec_init();
+        fec_init(options.at("stripe-threads").as<unsigned>());
 
         boost::asio::io_context io_context;
 
         unsigned channel = 123;
 
-        Node node(io_context, port);
+        Node node(io_context, port, options.at("decode-threads").as<unsigned>(),
+            options.at("cache-mb").as<std::uint64_t>() << 20);
+        if(options.count("output-dir"))
+        {
+            node.set_sink_factory([dir = options.at("output-dir").as<std::string>()](
+                std::uint32_t channel_id, std::uint32_t block_id, std::uint32_t size)
+            {
+                return std::make_shared<FileBlockSink>(dir + "/" +
+                    std::to_string(channel_id) + "-" + std::to_string(block_id),
+                    size);
+            });
+        }
         if(action == "proxy")
         {
+            node.set_forward_only(options.count("forward-only") > 0);
             node.listen();
             io_context.run();
         }
-        else if(action == "block")
+        else if(action == "block" || action == "objects")
         {
             auto server = udp::endpoint(asio::ip::make_address("127.0.0.1"),
-                options.at("connect").as<int>());
+                options.at("connect").as<std::vector<int>>().front());
             
-            AsioReceiver receiver = node.make_receiver(server, 2000);
-            
-            std::vector<char> message(options.at("size").as<int>(), 'j');
-            std::cout << "New block, crc=" << show_crc32{to_sv(message)} << std::endl;
-            
-            Block block(to_sv(message));
-            for(auto packet : block_packet_range(block, channel, 456, REDUNDANCY))
+            // The relay acks our blocks once it has decoded them
+            node.add_subscriber(channel, server, 2000);
+            BlockEncoderService encoder(io_context,
+                options.at("threads").as<unsigned>());
+
+            std::uint32_t next_block_id = 456;
+            unsigned const ttl = options.at("ttl-ms").as<unsigned>();
+            auto publish = [&](std::shared_ptr<Block> block) {
+                std::uint32_t block_id = next_block_id++;
+                // Newer blocks go first
+                if(ttl)
+                {
+                    block->set_schedule(BlockSchedule::expiring_in(block_id,
+                        std::chrono::milliseconds(ttl)));
+                }
+                else
+                {
+                    block->set_schedule({block_id});
+                }
+                std::cout << "New block, crc=" << show_crc32{block->decoded_data()}
+                    << " bid=" << block_id << std::endl;
+
+                // Original chunks go out while the encoder is being solved
+                node.publish(channel, block_id, block);
+                encoder.encode(block, [&node, channel, block_id](Block&) {
+                    node.publish_encoded(channel, block_id);
+                });
+            };
+
+            std::optional<BlockBatcher> batcher;
+            if(action == "block")
             {
-                receiver.queue_packet(packet.move_data());
+                int const n_blocks = options.count("file") ? 1 :
+                    options.at("blocks").as<int>();
+                for(int i = 0; i < n_blocks; ++i)
+                {
+                    if(options.count("file"))
+                    {
+                        // Encoder and original chunks work on the mapping directly
+                        auto file = std::make_shared<MappedFile>(
+                            options.at("file").as<std::string>());
+                        ENFORCE(file->size() <= std::numeric_limits<std::uint32_t>::max());
+                        publish(std::make_shared<Block>(
+                            std::shared_ptr<char const>(file, file->data()),
+                            file->size(), Block::DeferEncoding{}));
+                    }
+                    else
+                    {
+                        std::vector<char> message(options.at("size").as<int>(), 'j' + i);
+                        publish(std::make_shared<Block>(to_sv(message),
+                            Block::DeferEncoding{}));
+                    }
+                }
+            }
+            else
+            {
+                // Small objects of random size, a block per batch
+                batcher.emplace(io_context,
+                    options.at("batch-bytes").as<unsigned>(),
+                    std::chrono::milliseconds(options.at("batch-ms").as<unsigned>()),
+                    [&](Bytes batch, std::uint32_t n_objects) {
+                        std::cout << "New batch, n=" << n_objects << std::endl;
+                        auto data = std::make_shared<Bytes>(std::move(batch));
+                        auto block = std::make_shared<Block>(
+                            std::shared_ptr<char const>(data, data->data()),
+                            data->size(), Block::DeferEncoding{});
+                        block->set_content(BlockContent::BATCH);
+                        publish(std::move(block));
+                    });
+                for(int i = 0, n = options.at("blocks").as<int>(); i < n; ++i)
+                {
+                    Bytes object = random_chunk();
+                    std::cout << "New object, crc=" << show_crc32{to_sv(object)}
+                        << " ix=" << i << " size=" << object.size() << std::endl;
+                    batcher->add(std::move(object));
+                }
             }
 
+            node.listen();  // For the receiver reports
             io_context.run();
         }
         else if(action == "stream")
         {
             auto server = udp::endpoint(asio::ip::make_address("127.0.0.1"),
-                options.at("connect").as<int>());
+                options.at("connect").as<std::vector<int>>().front());
             
             AsioReceiver receiver = node.make_receiver(server, 2000);
             
@@ -100,17 +208,23 @@ int main(int argc, char** argv)
         }
         else if(action == "subscribe")
         {
-            auto server = udp::endpoint(asio::ip::make_address("127.0.0.1"),
-                options.at("connect").as<int>());
-            
-            AsioReceiver r = node.make_receiver(server, 100'000);
-            auto p = Packet::make<ControlPacketHeader>(
-                {},
-                ControlPacketHeader::Action::SUBSCRIBE,
-                channel,
-                options.at("kbps").as<unsigned>()
-            );
-            r.queue_packet(p.move_data());
+            // Each upstream gets its own share of the symbol indices
+            auto const& ports = options.at("connect").as<std::vector<int>>();
+            ENFORCE(ports.size() <= MAX_PARTITION_SLOTS);
+            for(std::uint32_t slot = 0; slot < ports.size(); ++slot)
+            {
+                auto server = udp::endpoint(asio::ip::make_address("127.0.0.1"),
+                    ports[slot]);
+                auto p = Packet::make<ControlPacketHeader>(
+                    {},
+                    ControlPacketHeader::Action::SUBSCRIBE,
+                    channel,
+                    options.at("kbps").as<unsigned>(),
+                    slot,
+                    std::uint32_t(ports.size())
+                );
+                node.send_bytes(server, p.move_data());
+            }
 
             node.listen();
             io_context.run();